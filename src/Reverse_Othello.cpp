@@ -9,34 +9,64 @@
 */
 
 #include <iostream>
+#include <algorithm>
 #include "engine/board.hpp"
 #include "engine/util.hpp"
+#include "state_encoding.hpp"
+#include "edge_table.hpp"
+#include "frozen_analysis.hpp"
+#include "search.hpp"
+#include "multi_goal.hpp"
+#include "estimate.hpp"
+#include "retrograde.hpp"
+#include "transcript.hpp"
+#include "waypoint.hpp"
+#include "verify.hpp"
+#include "position_index.hpp"
+#include "goal_generator.hpp"
+#include "frontier.hpp"
+#include "trace.hpp"
 
 
-void init(){
-    bit_init();
-    mobility_init();
-    flip_init();
-}
+/*
+    @brief read a board
+
+    With free_mask, ? is accepted as a cell with any content and as either side to move (PLAYER_ANY).
 
-bool input_board_line(std::string board_str, Board *board, int *player){
+    @param board_str            64 cells and the side to move
+    @param board                board to store (player is the side to move, black for PLAYER_ANY)
+    @param player               side to move to store
+    @param free_mask            cells with any content to store (nullptr: patterns not allowed)
+    @return valid?
+*/
+bool input_board_line(std::string board_str, Board *board, int *player, uint64_t *free_mask = nullptr){
     board_str.erase(std::remove_if(board_str.begin(), board_str.end(), ::isspace), board_str.end());
     if (board_str.length() != HW2 + 1){
         std::cerr << "[ERROR] invalid argument" << std::endl;
         return false;
     }
+    if (free_mask == nullptr && board_str.find('?') != std::string::npos){
+        std::cerr << "[ERROR] ? is not supported here" << std::endl;
+        return false;
+    }
     board->player = 0ULL;
     board->opponent = 0ULL;
+    if (free_mask != nullptr)
+        *free_mask = 0ULL;
     for (int i = 0; i < HW2; ++i){
         if (board_str[i] == 'B' || board_str[i] == 'b' || board_str[i] == 'X' || board_str[i] == 'x' || board_str[i] == '0' || board_str[i] == '*')
             board->player |= 1ULL << (HW2_M1 - i);
         else if (board_str[i] == 'W' || board_str[i] == 'w' || board_str[i] == 'O' || board_str[i] == 'o' || board_str[i] == '1')
             board->opponent |= 1ULL << (HW2_M1 - i);
+        else if (board_str[i] == '?')
+            *free_mask |= 1ULL << (HW2_M1 - i);
     }
     if (board_str[HW2] == 'B' || board_str[HW2] == 'b' || board_str[HW2] == 'X' || board_str[HW2] == 'x' || board_str[HW2] == '0' || board_str[HW2] == '*')
         *player = BLACK;
     else if (board_str[HW2] == 'W' || board_str[HW2] == 'w' || board_str[HW2] == 'O' || board_str[HW2] == 'o' || board_str[HW2] == '1')
         *player = WHITE;
+    else if (board_str[HW2] == '?')
+        *player = PLAYER_ANY;
     else{
         std::cerr << "[ERROR] invalid player argument" << std::endl;
         return false;
@@ -46,104 +76,562 @@ bool input_board_line(std::string board_str, Board *board, int *player){
     return true;
 }
 
-void output_transcript(std::vector<int> &transcript){
-    for (int &move: transcript){
-        std::cout << idx_to_coord(move);
+/*
+    @brief solve every goal given in stdin (one per line)
+
+    Goals with the same occupancy are searched together, MULTI_GOAL_MAX at a time.
+    A batch also takes goals whose occupancy contains or is contained in the occupancy
+    of a goal in the batch with at most MULTI_GOAL_NEST_DISCS more or fewer discs,
+    so a chain of nested occupancies is searched in one traversal.
+    Each transcript is prefixed with the index of its goal.
+
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param prefix               moves that led to the start board
+*/
+int solve_multi(const Board *start, int start_player, const std::vector<int> &prefix){
+    std::vector<Board> goals;
+    std::vector<int> goal_players;
+    std::string board_str;
+    while (getline(std::cin, board_str)){
+        if (std::all_of(board_str.begin(), board_str.end(), ::isspace))
+            continue;
+        Board goal;
+        int goal_player;
+        if (!input_board_line(board_str, &goal, &goal_player))
+            return 1;
+        std::cout << goals.size() << " " << board_str << std::endl;
+        goals.emplace_back(goal);
+        goal_players.emplace_back(goal_player);
+    }
+    std::vector<uint64_t> n_solutions(goals.size(), 0);
+    std::vector<bool> done(goals.size(), false);
+    uint64_t strt = tim();
+    uint64_t n_nodes = 0;
+    for (int i = 0; i < (int)goals.size(); ++i){
+        if (done[i])
+            continue;
+        std::vector<int> batch = {i};
+        std::vector<uint64_t> batch_masks = {goals[i].player | goals[i].opponent};
+        done[i] = true;
+        for (bool added = true; added && (int)batch.size() < MULTI_GOAL_MAX;){
+            added = false;
+            for (int j = i + 1; j < (int)goals.size() && (int)batch.size() < MULTI_GOAL_MAX; ++j){
+                if (done[j])
+                    continue;
+                uint64_t mask = goals[j].player | goals[j].opponent;
+                for (uint64_t goal_mask: batch_masks){
+                    bool nested = (mask & goal_mask) == mask || (mask & goal_mask) == goal_mask;
+                    if (nested && pop_count_ull(mask ^ goal_mask) <= MULTI_GOAL_NEST_DISCS){
+                        batch.emplace_back(j);
+                        batch_masks.emplace_back(mask);
+                        done[j] = true;
+                        added = true;
+                        break;
+                    }
+                }
+            }
+        }
+        Board batch_goals[MULTI_GOAL_MAX];
+        int batch_players[MULTI_GOAL_MAX];
+        for (int j = 0; j < (int)batch.size(); ++j){
+            batch_goals[j] = goals[batch[j]];
+            batch_players[j] = goal_players[batch[j]];
+        }
+        uint64_t trace_ts = trace_begin();
+        Multi_goal multi_goal;
+        multi_goal.init(batch_goals, batch_players, batch.data(), (int)batch.size());
+        Board board = *start;
+        std::vector<int> path = prefix;
+        find_path_multi(&board, path, start_player, &multi_goal, multi_goal.all_goals(), &n_nodes);
+        trace_end("goals", "multi", trace_ts, batch.size());
+        for (int j = 0; j < (int)batch.size(); ++j)
+            n_solutions[batch[j]] = multi_goal.n_solutions[j];
     }
-    std::cout << std::endl;
+    uint64_t elapsed = tim() - strt;
+    uint64_t n_solutions_all = 0;
+    for (int i = 0; i < (int)goals.size(); ++i){
+        std::cout << "goal " << i << " " << n_solutions[i] << " solutions" << std::endl;
+        n_solutions_all += n_solutions[i];
+    }
+    std::cout << "found " << n_solutions_all << " solutions for " << goals.size() << " goals in " << elapsed << " ms " << n_nodes << " nodes" << std::endl;
+    std::cerr << "found " << n_solutions_all << " solutions for " << goals.size() << " goals in " << elapsed << " ms " << n_nodes << " nodes" << std::endl;
+    return 0;
 }
 
-inline uint64_t full_stability_h(uint64_t full){
-    full &= full >> 1;
-    full &= full >> 2;
-    full &= full >> 4;
-    return (full & 0x0101010101010101ULL) * 0xFF;
+/*
+    @brief solve the waypoints given in stdin (one per line, the last one is the goal)
+
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param prefix               moves that led to the start board
+    @param count_only           only count the games
+*/
+int solve_waypoints(const Board *start, int start_player, const std::vector<int> &prefix, bool count_only){
+    std::vector<Board> waypoints;
+    std::vector<int> players;
+    std::string board_str;
+    while (getline(std::cin, board_str)){
+        if (std::all_of(board_str.begin(), board_str.end(), ::isspace))
+            continue;
+        Board waypoint;
+        int player;
+        if (!input_board_line(board_str, &waypoint, &player))
+            return 1;
+        std::cout << waypoints.size() << " " << board_str << std::endl;
+        waypoints.emplace_back(waypoint);
+        players.emplace_back(player);
+    }
+    if (waypoints.empty()){
+        std::cerr << "[ERROR] no waypoints" << std::endl;
+        return 1;
+    }
+    uint64_t strt = tim();
+    Waypoint_search waypoint_search;
+    waypoint_search.init(start, start_player, waypoints, players);
+    uint64_t n_solutions = waypoint_search.search(count_only);
+    if (!count_only && n_solutions){
+        std::vector<int> transcript = prefix;
+        output_transcript_waypoint(&waypoint_search, 0, transcript);
+    }
+    uint64_t elapsed = tim() - strt;
+    for (int i = 0; i < (int)waypoints.size(); ++i)
+        std::cout << "segment " << i << " " << waypoint_search.n_solutions[i] << " solutions" << std::endl;
+    // the product of the segments does not fit in 64 bits
+    std::string n_solutions_str = (waypoint_search.overflow ? "more than " : "") + std::to_string(n_solutions);
+    std::cout << "found " << n_solutions_str << " solutions in " << elapsed << " ms " << waypoint_search.n_nodes << " nodes" << std::endl;
+    std::cerr << "found " << n_solutions_str << " solutions in " << elapsed << " ms " << waypoint_search.n_nodes << " nodes" << std::endl;
+    return 0;
 }
 
-inline uint64_t full_stability_v(uint64_t full){
-    full &= (full >> 8) | (full << 56);
-    full &= (full >> 16) | (full << 48);
-    full &= (full >> 32) | (full << 32);
-    return full;
+/*
+    @brief verify transcripts given in stdin
+
+    The input is solution files: a goal line followed by its transcripts.
+    Lines starting with "found" and empty lines are skipped. Transcripts are replayed
+    from the start board, so they include the moves of the prefix as the other modes write them.
+
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param n_threads            number of threads
+*/
+int solve_verify(const Board *start, int start_player, int n_threads){
+    std::vector<Verify_goal> goals;
+    std::vector<Verify_transcript> items;
+    std::string line;
+    int line_no = 0;
+    while (getline(std::cin, line)){
+        ++line_no;
+        line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+        if (line.empty() || line.compare(0, 5, "found") == 0)
+            continue;
+        if ((int)line.length() == HW2 + 1){
+            Board goal;
+            int goal_player;
+            uint64_t goal_free;
+            if (!input_board_line(line, &goal, &goal_player, &goal_free))
+                return 1;
+            if (goal_player == WHITE)
+                std::swap(goal.player, goal.opponent);
+            goals.emplace_back(Verify_goal{goal.player, goal.opponent, goal_free, goal_player});
+            continue;
+        }
+        std::transform(line.begin(), line.end(), line.begin(), ::tolower);
+        items.emplace_back(Verify_transcript{line_no, (int)goals.size() - 1, line, VERIFY_OK, 0});
+    }
+    uint64_t strt = tim();
+    uint64_t n_moves = verify_transcripts(goals, start, start_player, items, n_threads);
+    uint64_t elapsed = tim() - strt;
+    std::sort(items.begin(), items.end(), [](const Verify_transcript &a, const Verify_transcript &b){
+        return a.line < b.line;
+    });
+    uint64_t n_invalid = 0;
+    for (const Verify_transcript &item: items){
+        if (item.result != VERIFY_OK){
+            std::cout << "invalid line " << item.line << " " << item.transcript << " " << verify_result_str[item.result];
+            if (item.ply)
+                std::cout << " at move " << item.ply;
+            std::cout << std::endl;
+            ++n_invalid;
+        }
+    }
+    double seconds = std::max<uint64_t>(elapsed, 1) / 1000.0;
+    std::cout << "verified " << items.size() << " transcripts of " << goals.size() << " goals, " << n_invalid << " invalid, in " << elapsed << " ms " << n_moves << " moves" << std::endl;
+    std::cout << (uint64_t)(items.size() / seconds) << " transcripts/s " << (uint64_t)(n_moves / seconds) << " moves/s with " << n_threads << " threads" << std::endl;
+    std::cerr << "verified " << items.size() << " transcripts, " << n_invalid << " invalid, in " << elapsed << " ms" << std::endl;
+    return n_invalid ? 2 : 0;
 }
 
-inline void full_stability_d(uint64_t full, uint64_t *full_d7, uint64_t *full_d9){
-    constexpr uint64_t edge = 0xFF818181818181FFULL;
-    uint64_t l7, r7, l9, r9;
-    l7 = r7 = full;
-    l7 &= edge | (l7 >> 7);		r7 &= edge | (r7 << 7);
-    l7 &= 0xFFFF030303030303ULL | (l7 >> 14);	r7 &= 0xC0C0C0C0C0C0FFFFULL | (r7 << 14);
-    l7 &= 0xFFFFFFFF0F0F0F0FULL | (l7 >> 28);	r7 &= 0xF0F0F0F0FFFFFFFFULL | (r7 << 28);
-    *full_d7 = l7 & r7;
-
-    l9 = r9 = full;
-    l9 &= edge | (l9 >> 9);		r9 &= edge | (r9 << 9);
-    l9 &= 0xFFFFC0C0C0C0C0C0ULL | (l9 >> 18);	r9 &= 0x030303030303FFFFULL | (r9 << 18);
-    *full_d9 = l9 & r9 & (0x0F0F0F0FF0F0F0F0ULL | (l9 >> 36) | (r9 << 36));
+/*
+    @brief build a position index of the games given in stdin (one transcript per line)
+
+    The game id is the line number. Goal lines and lines starting with "found" are skipped,
+    so solution files can be indexed as they are.
+
+    @param path                 index file
+*/
+int build_position_index(const std::string &path){
+    Position_index_builder builder;
+    builder.init(path);
+    std::string line;
+    uint32_t line_no = 0;
+    uint64_t n_invalid = 0;
+    uint64_t strt = tim();
+    while (getline(std::cin, line)){
+        ++line_no;
+        line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+        if (line.empty() || line.compare(0, 5, "found") == 0 || (int)line.length() == HW2 + 1)
+            continue;
+        if (!builder.add(line, line_no)){
+            std::cout << "invalid line " << line_no << " " << line << std::endl;
+            ++n_invalid;
+        }
+    }
+    if (!builder.finish())
+        return 1;
+    uint64_t elapsed = tim() - strt;
+    std::cout << "indexed " << builder.n_games << " games " << builder.n_entries << " positions, " << n_invalid << " invalid, in " << elapsed << " ms" << std::endl;
+    std::cerr << "indexed " << builder.n_games << " games " << builder.n_entries << " positions, " << n_invalid << " invalid, in " << elapsed << " ms" << std::endl;
+    return 0;
 }
 
-inline void full_stability(uint64_t discs, uint64_t *h, uint64_t *v, uint64_t *d7, uint64_t *d9){
-    *h = full_stability_h(discs);
-    *v = full_stability_v(discs);
-    full_stability_d(discs, d7, d9);
+/*
+    @brief show the archived games that reach the boards given in stdin (one per line)
+
+    @param path                 index file
+*/
+int query_position_index(const std::string &path){
+    Position_index index;
+    if (!index.open(path))
+        return 1;
+    std::string board_str;
+    while (getline(std::cin, board_str)){
+        if (std::all_of(board_str.begin(), board_str.end(), ::isspace))
+            continue;
+        Board board;
+        int player;
+        if (!input_board_line(board_str, &board, &player))
+            return 1;
+        uint64_t black = player == BLACK ? board.player : board.opponent;
+        uint64_t white = player == BLACK ? board.opponent : board.player;
+        uint64_t strt = tim();
+        uint64_t n;
+        const Position_index_entry *entry = index.find(black, white, player, &n);
+        uint64_t elapsed = tim() - strt;
+        std::cout << board_str << std::endl;
+        for (uint64_t i = 0; i < n; ++i)
+            std::cout << "game " << entry[i].game << " ply " << entry[i].ply << std::endl;
+        std::cout << "found " << n << " games in " << elapsed << " ms" << std::endl;
+    }
+    return 0;
 }
 
-inline uint64_t enhanced_stability(Board *board, const uint64_t goal_mask){
-    uint64_t full_h, full_v, full_d7, full_d9;
-    uint64_t discs = board->player | board->opponent;
-    full_stability(discs | ~goal_mask, &full_h, &full_v, &full_d7, &full_d9);
-    full_h &= goal_mask;
-    full_v &= goal_mask;
-    full_d7 &= goal_mask;
-    full_d9 &= goal_mask;
-    uint64_t h, v, d7, d9;
-    uint64_t stability = 0ULL, n_stability;
-    n_stability = discs & (full_h & full_v & full_d7 & full_d9);
-    while (n_stability & ~stability){
-        stability |= n_stability;
-        h = (stability >> 1) | (stability << 1) | full_h;
-        v = (stability >> 8) | (stability << 8) | full_v;
-        d7 = (stability >> 7) | (stability << 7) | full_d7;
-        d9 = (stability >> 9) | (stability << 9) | full_d9;
-        n_stability = h & v & d7 & d9;
-    }
-    return stability;
+/*
+    @brief generate goals with a known transcript and their difficulty
+
+    Each goal is shown as in the solution files: the goal line, the transcript that generated it,
+    and a line with the number of solutions and the nodes the forward search needs
+    (or their estimates with estimate_time > 0).
+
+    @param generator            goal generator
+    @param n_goals              number of goals
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param prefix               moves that led to the start board
+    @param estimate_time        time budget in ms to estimate each goal, 0 to solve it
+*/
+int solve_generate(const Goal_generator *generator, uint64_t n_goals, const Board *start, int start_player, const std::vector<int> &prefix, uint64_t estimate_time){
+    uint64_t strt = tim();
+    uint64_t n_nodes_all = 0;
+    for (uint64_t i = 0; i < n_goals; ++i){
+        uint64_t trace_ts = trace_begin();
+        Board goal;
+        int goal_player;
+        std::vector<int> moves;
+        if (!generator->generate(i, start, start_player, &goal, &goal_player, moves)){
+            std::cerr << "[ERROR] no game of " << generator->n_moves << " moves without a pass" << std::endl;
+            return 1;
+        }
+        uint64_t black = goal_player == BLACK ? goal.player : goal.opponent;
+        uint64_t white = goal_player == BLACK ? goal.opponent : goal.player;
+        std::cout << board_line(black, white, goal_player) << std::endl;
+        std::vector<int> transcript = prefix;
+        transcript.insert(transcript.end(), moves.begin(), moves.end());
+        output_transcript(transcript);
+        Path_context ctx;
+        ctx.init(&goal, goal_player);
+        ctx.set_start(start, (int)prefix.size());
+        if (estimate_time){
+            Estimate_result res = estimate_path(*start, start_player, &ctx, estimate_time);
+            std::cout << "found " << (uint64_t)res.solutions.mean << " solutions " << (uint64_t)res.nodes.mean << " nodes (estimated)" << std::endl;
+            n_nodes_all += (uint64_t)res.nodes.mean;
+        } else{
+            ctx.output_mode = PATH_OUTPUT_COUNT;
+            Board board = *start;
+            std::vector<int> path = prefix;
+            find_path(&board, path, start_player, &ctx);
+            std::cout << "found " << ctx.n_solutions << " solutions " << ctx.n_nodes << " nodes" << std::endl;
+            n_nodes_all += ctx.n_nodes;
+        }
+        trace_end("goal", "generate", trace_ts, i);
+    }
+    uint64_t elapsed = tim() - strt;
+    std::cerr << "generated " << n_goals << " goals of " << generator->n_moves << " moves in " << elapsed << " ms " << n_nodes_all << " nodes" << std::endl;
+    return 0;
+}
+
+/*
+    @brief search with a breadth-first frontier and parallel depth-first searches below it
+
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param prefix               moves that led to the start board
+    @param ctx                  search context (not a pattern), n_nodes and n_solutions are stored
+    @param memory_budget        memory budget of the frontier in bytes
+    @param n_threads            number of threads
+    @param n_left_min           moves left at least below the frontier
+*/
+void solve_frontier(const Board *start, int start_player, const std::vector<int> &prefix, Path_context *ctx, uint64_t memory_budget, int n_threads, int n_left_min){
+    Frontier_search frontier_search;
+    bool print = ctx->output_mode != PATH_OUTPUT_COUNT;
+    frontier_search.init(start, start_player, (int)prefix.size(), ctx, memory_budget, print, n_left_min);
+    const int frontier_level = (int)frontier_search.levels.size() - 1;
+    std::cerr << "frontier " << frontier_level << " moves " << frontier_search.levels.back().boards.size() << " positions" << std::endl;
+    frontier_search.search(start_player, (int)prefix.size(), ctx, n_threads);
+    if (print){
+        std::vector<int> reversed_moves, transcript;
+        for (uint32_t i = 0; i < (uint32_t)frontier_search.suffixes.size(); ++i){
+            const std::vector<std::vector<int>> &suffixes = frontier_search.suffixes[i];
+            if (suffixes.empty())
+                continue;
+            auto f = [&](const std::vector<int> &moves){
+                for (const std::vector<int> &suffix: suffixes){
+                    transcript = prefix;
+                    transcript.insert(transcript.end(), moves.rbegin(), moves.rend());
+                    transcript.insert(transcript.end(), suffix.begin(), suffix.end());
+                    output_transcript(transcript);
+                }
+            };
+            frontier_search.for_each_prefix(frontier_level, i, reversed_moves, f);
+        }
+    }
+    ctx->n_nodes = frontier_search.n_nodes;
+    ctx->n_solutions = frontier_search.n_solutions;
 }
 
-void find_path(Board *board, std::vector<int> &path, int player, const uint64_t goal_mask, const uint64_t corner_mask, const int goal_n_discs, const Board *goal, const int goal_player, uint64_t *n_nodes, uint64_t *n_solutions){
-    ++(*n_nodes);
-    if (player == goal_player && board->player == goal->player && board->opponent == goal->opponent){
-        output_transcript(path);
-        ++(*n_solutions);
-        return;
-    }
-    uint64_t goal_board_player, goal_board_opponent;
-    if (player != goal_player){
-        goal_board_player = goal->opponent;
-        goal_board_opponent = goal->player;
-    } else{
-        goal_board_player = goal->player;
-        goal_board_opponent = goal->opponent;
-    }
-    uint64_t stable = enhanced_stability(board, goal_mask);
-    if ((stable & board->player & goal_board_opponent) || (stable & board->opponent & goal_board_player))
-        return;
-    uint64_t legal = board->get_legal() & goal_mask & ~(corner_mask & goal_board_opponent);
-    if (legal){
-        Flip flip;
-        for (uint_fast8_t cell = first_bit(&legal); legal; cell = next_bit(&legal)){;
-            calc_flip(&flip, board, cell);
-            board->move_board(&flip);
-            path.emplace_back(cell);
-                find_path(board, path, player ^ 1, goal_mask, corner_mask, goal_n_discs, goal, goal_player, n_nodes, n_solutions);
-            path.pop_back();
-            board->undo_board(&flip);
+// operations per thread of the stress test of the shared table
+#define TABLE_BENCH_STRESS_OPS 4000000
+
+/*
+    @brief check the shared table and measure the frontier search with 1 to n_threads threads
+
+    First threads write and read random boards in a table of one bucket, and every result read
+    is checked. Then the goal is counted without the table, and with a new table for each number
+    of threads; all counts must be equal. The frontier stops SHARED_TABLE_FRONTIER_PLIES moves
+    before the last move in all runs, so that the table is used below it.
+
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param prefix               moves that led to the start board
+    @param ctx                  search context (not a pattern)
+    @param memory_budget        memory budget of the frontier in bytes
+    @param n_threads            maximum number of threads
+    @param table_mb             size of the shared table in MB
+    @param huge_pages           back the shared table with huge pages
+    @return 0 if all checks passed, 2 otherwise
+*/
+int solve_table_bench(const Board *start, int start_player, const std::vector<int> &prefix, const Path_context *ctx, uint64_t memory_budget, int n_threads, uint64_t table_mb, bool huge_pages){
+    bool ok = true;
+    {
+        Shared_table table;
+        table.init(0, false);
+        uint64_t strt = tim();
+        uint64_t n_wrong = shared_table_stress(&table, std::max(n_threads, 2), TABLE_BENCH_STRESS_OPS, 64);
+        uint64_t elapsed = tim() - strt;
+        std::cout << "stress " << std::max(n_threads, 2) << " threads " << TABLE_BENCH_STRESS_OPS << " operations each in " << elapsed << " ms, " << n_wrong << " wrong results" << std::endl;
+        ok &= n_wrong == 0;
+    }
+    Path_context bench_ctx = *ctx;
+    bench_ctx.output_mode = PATH_OUTPUT_COUNT;
+    bench_ctx.dead_cache = nullptr;
+    bench_ctx.prune_schedule = nullptr;
+    bench_ctx.perf_counters = nullptr;
+    bench_ctx.set_control(nullptr, 0);
+    std::vector<int> thread_counts;
+    for (int t = 1; t < n_threads; t *= 2)
+        thread_counts.emplace_back(t);
+    thread_counts.emplace_back(n_threads);
+    uint64_t n_solutions = 0;
+    for (int i = -1; i < (int)thread_counts.size(); ++i){
+        // i = -1: one thread without the table
+        int t = i < 0 ? 1 : thread_counts[i];
+        Shared_table table;
+        if (i >= 0 && !table.init(table_mb, huge_pages)){
+            std::cerr << "[ERROR] can't allocate the shared table" << std::endl;
+            return 1;
         }
+        bench_ctx.shared_table = i < 0 ? nullptr : &table;
+        bench_ctx.n_nodes = 0;
+        bench_ctx.n_solutions = 0;
+        uint64_t strt = tim();
+        solve_frontier(start, start_player, prefix, &bench_ctx, memory_budget, t, SHARED_TABLE_FRONTIER_PLIES);
+        uint64_t elapsed = tim() - strt;
+        if (i < 0)
+            n_solutions = bench_ctx.n_solutions;
+        std::cout << (i < 0 ? "no table " : "table ") << t << " threads " << bench_ctx.n_solutions << " solutions in " << elapsed << " ms " << bench_ctx.n_nodes << " nodes";
+        if (i >= 0)
+            std::cout << " hits " << table.n_hits << " stores " << table.n_stores;
+        std::cout << std::endl;
+        ok &= bench_ctx.n_solutions == n_solutions;
     }
+    std::cout << (ok ? "shared table ok" : "shared table FAILED") << std::endl;
+    std::cerr << (ok ? "shared table ok" : "shared table FAILED") << std::endl;
+    return ok ? 0 : 2;
 }
 
+// search direction
+#define DIRECTION_FORWARD 0
+#define DIRECTION_BACKWARD 1
+#define DIRECTION_AUTO 2
+
+// time budget of each estimation to choose the direction
+#define DIRECTION_AUTO_ESTIMATE_TIME 100
+
 int main(int argc, char* argv[]){
-    init();
+    bool multi_mode = false;
+    bool waypoint_mode = false;
+    bool count_only = false;
+    bool verify_mode = false;
+    std::string index_build_path, index_query_path;
+    int n_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    bool estimate_mode = false;
+    uint64_t estimate_time = 1000;
+    int direction = DIRECTION_FORWARD;
+    Board start = {INITIAL_BLACK, INITIAL_WHITE};
+    int start_player = BLACK;
+    std::string prefix_str;
+    std::string cache_path;
+    uint64_t n_generate = 0;
+    bool frontier_mode = false;
+    bool adaptive_pruning = false;
+    bool perf_mode = false;
+    Search_control control;
+    uint64_t frontier_memory = 32;
+    std::string trace_path;
+    uint64_t table_mb = 0;
+    bool huge_pages = false;
+    bool table_bench = false;
+    Goal_generator generator = {1, 20, 0.0};
+    uint64_t cache_size = DEAD_CACHE_DEFAULT_ENTRIES;
+    for (int i = 1; i < argc; ++i){
+        std::string arg = argv[i];
+        if (arg == "--multi")
+            multi_mode = true;
+        else if (arg == "--waypoints")
+            waypoint_mode = true;
+        else if (arg == "--count")
+            count_only = true;
+        else if (arg == "--verify")
+            verify_mode = true;
+        else if (arg == "--index-build" && i + 1 < argc)
+            index_build_path = argv[++i];
+        else if (arg == "--index-query" && i + 1 < argc)
+            index_query_path = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            n_threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--estimate")
+            estimate_mode = true;
+        else if (arg == "--estimate-time" && i + 1 < argc){
+            estimate_mode = true;
+            estimate_time = std::stoull(argv[++i]);
+        } else if (arg == "--direction" && i + 1 < argc){
+            std::string direction_str = argv[++i];
+            if (direction_str == "forward")
+                direction = DIRECTION_FORWARD;
+            else if (direction_str == "backward")
+                direction = DIRECTION_BACKWARD;
+            else if (direction_str == "auto")
+                direction = DIRECTION_AUTO;
+            else{
+                std::cerr << "[ERROR] invalid direction " << direction_str << std::endl;
+                return 1;
+            }
+        } else if (arg == "--start" && i + 1 < argc){
+            if (!input_board_line(argv[++i], &start, &start_player))
+                return 1;
+        } else if (arg == "--prefix" && i + 1 < argc)
+            prefix_str = argv[++i];
+        else if (arg == "--cache" && i + 1 < argc)
+            cache_path = argv[++i];
+        else if (arg == "--cache-size" && i + 1 < argc)
+            cache_size = std::stoull(argv[++i]);
+        else if (arg == "--adaptive-pruning")
+            adaptive_pruning = true;
+        else if (arg == "--perf-counters")
+            perf_mode = true;
+        else if (arg == "--time-limit" && i + 1 < argc)
+            control.time_limit = std::stoull(argv[++i]);
+        else if (arg == "--node-limit" && i + 1 < argc)
+            control.node_limit = std::stoull(argv[++i]);
+        else if (arg == "--progress" && i + 1 < argc)
+            control.progress_interval = std::stoull(argv[++i]);
+        else if (arg == "--trace" && i + 1 < argc)
+            trace_path = argv[++i];
+        else if (arg == "--shared-table" && i + 1 < argc)
+            table_mb = std::stoull(argv[++i]);
+        else if (arg == "--huge-pages")
+            huge_pages = true;
+        else if (arg == "--table-bench")
+            table_bench = true;
+        else if (arg == "--frontier")
+            frontier_mode = true;
+        else if (arg == "--frontier-memory" && i + 1 < argc){
+            frontier_mode = true;
+            frontier_memory = std::stoull(argv[++i]);
+        } else if (arg == "--generate" && i + 1 < argc)
+            n_generate = std::stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            generator.seed = std::stoull(argv[++i]);
+        else if (arg == "--ply" && i + 1 < argc)
+            generator.n_moves = std::stoi(argv[++i]);
+        else if (arg == "--bias" && i + 1 < argc)
+            generator.bias = std::stod(argv[++i]);
+        else{
+            std::cerr << "[ERROR] unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    // the trace is written when the program exits
+    if (!trace_path.empty()){
+        trace.start(trace_path);
+        trace_thread_name("main");
+    }
+    if (!index_build_path.empty()){
+        std::cerr << "please input games, one transcript per line" << std::endl;
+        return build_position_index(index_build_path);
+    }
+    if (!index_query_path.empty()){
+        std::cerr << "please input boards, one per line (X: black O: white)" << std::endl;
+        return query_position_index(index_query_path);
+    }
+    if (verify_mode){
+        std::cerr << "please input solution files (goal line followed by transcripts)" << std::endl;
+        return solve_verify(&start, start_player, n_threads);
+    }
+    // the prefix is replayed from the start position
+    std::vector<int> prefix;
+    if (!replay_transcript(prefix_str, &start, &start_player, prefix))
+        return 1;
+    if (n_generate)
+        return solve_generate(&generator, n_generate, &start, start_player, prefix, estimate_mode ? estimate_time : 0);
+    if (multi_mode){
+        std::cerr << "please input boards, one per line (X: black O: white)" << std::endl;
+        return solve_multi(&start, start_player, prefix);
+    }
+    if (waypoint_mode){
+        std::cerr << "please input boards to pass through in order, one per line (X: black O: white)" << std::endl;
+        return solve_waypoints(&start, start_player, prefix, count_only);
+    }
     std::cerr << "please input the board (X: black O: white)" << std::endl;
     std::cerr << "example: ------------------O--X---OOOXXX--OOOXXX---OOXX-----OX----------- X" << std::endl;
     //Board goal = input_board();
@@ -152,49 +640,132 @@ int main(int argc, char* argv[]){
     std::cout << board_str << std::endl;
     Board goal;
     int goal_player;
-    if (!input_board_line(board_str, &goal, &goal_player))
+    uint64_t goal_free;
+    if (!input_board_line(board_str, &goal, &goal_player, &goal_free))
         return 1;
     goal.print();
+    // without passes the number of discs fixes the side to move of a full goal, so it is searched for that side only
+    const bool both_sides = goal_player == PLAYER_ANY;
+    if (both_sides && goal_free == 0ULL){
+        goal_player = side_to_move(pop_count_ull(goal.player | goal.opponent), start.n_discs(), start_player);
+        if (goal_player == WHITE)
+            std::swap(goal.player, goal.opponent);
+        std::cerr << "side to move of the goal: " << (goal_player == BLACK ? "black" : "white") << " (the other side needs a pass)" << std::endl;
+    }
 
-    uint64_t goal_mask = goal.player | goal.opponent; // legal candidate
-    uint64_t corner_mask = 0ULL; // cells that work as corner (non-flippable cells)
-    uint64_t empty_mask_r1 = ((~goal_mask & 0xFEFEFEFEFEFEFEFEULL) >> 1) | 0x8080808080808080ULL;
-    uint64_t empty_mask_l1 = ((~goal_mask & 0x7F7F7F7F7F7F7F7FULL) << 1) | 0x0101010101010101ULL;
-    uint64_t empty_mask_r8 = ((~goal_mask & 0xFFFFFFFFFFFFFF00ULL) >> 8) | 0xFF00000000000000ULL;
-    uint64_t empty_mask_l8 = ((~goal_mask & 0x00FFFFFFFFFFFFFFULL) << 8) | 0x00000000000000FFULL;
-    uint64_t empty_mask_r7 = ((~goal_mask & 0x7F7F7F7F7F7F7F00ULL) >> 7) | 0xFF01010101010101ULL;
-    uint64_t empty_mask_l7 = ((~goal_mask & 0x00FEFEFEFEFEFEFEULL) << 7) | 0x80808080808080FFULL;
-    uint64_t empty_mask_r9 = ((~goal_mask & 0xFEFEFEFEFEFEFE00ULL) >> 9) | 0x01010101010101FFULL;
-    uint64_t empty_mask_l9 = ((~goal_mask & 0x007F7F7F7F7F7F7FULL) << 9) | 0xFF80808080808080ULL;
-    corner_mask |= empty_mask_r1 & empty_mask_r8 & empty_mask_r9 & empty_mask_r7;
-    corner_mask |= empty_mask_r1 & empty_mask_r8 & empty_mask_r9 & empty_mask_l7;
-    corner_mask |= empty_mask_r1 & empty_mask_r8 & empty_mask_l9 & empty_mask_r7;
-    corner_mask |= empty_mask_r1 & empty_mask_r8 & empty_mask_l9 & empty_mask_l7;
-    corner_mask |= empty_mask_r1 & empty_mask_l8 & empty_mask_r9 & empty_mask_r7;
-    corner_mask |= empty_mask_r1 & empty_mask_l8 & empty_mask_r9 & empty_mask_l7;
-    corner_mask |= empty_mask_r1 & empty_mask_l8 & empty_mask_l9 & empty_mask_r7;
-    corner_mask |= empty_mask_r1 & empty_mask_l8 & empty_mask_l9 & empty_mask_l7;
-    corner_mask |= empty_mask_l1 & empty_mask_r8 & empty_mask_r9 & empty_mask_r7;
-    corner_mask |= empty_mask_l1 & empty_mask_r8 & empty_mask_r9 & empty_mask_l7;
-    corner_mask |= empty_mask_l1 & empty_mask_r8 & empty_mask_l9 & empty_mask_r7;
-    corner_mask |= empty_mask_l1 & empty_mask_r8 & empty_mask_l9 & empty_mask_l7;
-    corner_mask |= empty_mask_l1 & empty_mask_l8 & empty_mask_r9 & empty_mask_r7;
-    corner_mask |= empty_mask_l1 & empty_mask_l8 & empty_mask_r9 & empty_mask_l7;
-    corner_mask |= empty_mask_l1 & empty_mask_l8 & empty_mask_l9 & empty_mask_r7;
-    corner_mask |= empty_mask_l1 & empty_mask_l8 & empty_mask_l9 & empty_mask_l7;
-    corner_mask &= goal_mask;
-
-    //bit_print_board(goal_mask);
-    //bit_print_board(corner_mask);
-
-    int n_discs = pop_count_ull(goal_mask);
-    Board board = {0x0000000810000000ULL, 0x0000001008000000ULL};
-    std::vector<int> path;
+    Path_context ctx;
+    ctx.init(&goal, goal_player, goal_free);
+    ctx.set_start(&start, (int)prefix.size());
+    if (count_only)
+        ctx.output_mode = PATH_OUTPUT_COUNT;
+
+    //bit_print_board(ctx.goal_mask);
+    //bit_print_board(ctx.corner_mask);
+
+    Board board = start;
+    // the backward search starts from one position
+    if (ctx.is_pattern()){
+        if (direction == DIRECTION_BACKWARD){
+            std::cerr << "[ERROR] backward search needs a fully specified board" << std::endl;
+            return 1;
+        }
+        direction = DIRECTION_FORWARD;
+    }
+    if (direction == DIRECTION_AUTO){
+        Estimate_result forward = estimate_path(board, start_player, &ctx, DIRECTION_AUTO_ESTIMATE_TIME);
+        Estimate_result backward = estimate_path_backward(&goal, goal_player, &start, start_player, DIRECTION_AUTO_ESTIMATE_TIME);
+        direction = backward.nodes.mean * backward.ms_per_node < forward.nodes.mean * forward.ms_per_node ? DIRECTION_BACKWARD : DIRECTION_FORWARD;
+        std::cerr << "search " << (direction == DIRECTION_BACKWARD ? "backward" : "forward") << std::endl;
+    }
+    if (estimate_mode){
+        Estimate_result res;
+        if (direction == DIRECTION_BACKWARD)
+            res = estimate_path_backward(&goal, goal_player, &start, start_player, estimate_time);
+        else
+            res = estimate_path(board, start_player, &ctx, estimate_time);
+        print_estimate(res);
+        return 0;
+    }
+    if (table_bench){
+        if (ctx.is_pattern()){
+            std::cerr << "[ERROR] the benchmark needs a fully specified board" << std::endl;
+            return 1;
+        }
+        return solve_table_bench(&start, start_player, prefix, &ctx, frontier_memory << 20, n_threads, table_mb ? table_mb : SHARED_TABLE_DEFAULT_MB, huge_pages);
+    }
+    Shared_table shared_table;
+    if (table_mb && direction != DIRECTION_BACKWARD){
+        if (!shared_table.init(table_mb, huge_pages)){
+            std::cerr << "[ERROR] can't allocate the shared table" << std::endl;
+            return 1;
+        }
+        ctx.shared_table = &shared_table;
+    }
+    std::vector<int> path = prefix;
     uint64_t strt = tim();
-    uint64_t n_nodes = 0, n_solutions = 0;
-    find_path(&board, path, BLACK, goal_mask, corner_mask, n_discs, &goal, goal_player, &n_nodes, &n_solutions);
+    uint64_t trace_ts = trace_begin();
+    if (direction == DIRECTION_BACKWARD){
+        // without passes the side to move is fixed by the number of discs
+        if (goal_player == side_to_move(ctx.goal_n_discs, start.n_discs(), start_player)){
+            Retrograde_search retrograde_search;
+            retrograde_search.init(ctx.goal_mask);
+            retrograde_search.set_start(&start, start_player, prefix);
+            retrograde_search.print = !count_only;
+            std::vector<int> backward_path;
+            find_path_backward(&goal, backward_path, goal_player, &retrograde_search, &ctx.n_nodes, &ctx.n_solutions);
+        }
+    } else if (frontier_mode && !ctx.is_pattern())
+        solve_frontier(&start, start_player, prefix, &ctx, frontier_memory << 20, n_threads, ctx.shared_table != nullptr ? SHARED_TABLE_FRONTIER_PLIES : 0);
+    else{
+        Dead_cache dead_cache;
+        if (!cache_path.empty()){
+            uint64_t goal_black = ctx.goal_player == BLACK ? goal.player : goal.opponent;
+            uint64_t goal_white = ctx.goal_player == BLACK ? goal.opponent : goal.player;
+            dead_cache.init(cache_path, dead_cache_goal_key(goal_black, goal_white, ctx.free_mask, goal_player), ctx.goal_mask, cache_size);
+            ctx.dead_cache = &dead_cache;
+        }
+        Prune_schedule prune_schedule;
+        if (adaptive_pruning){
+            prune_schedule.init(ctx.n_nodes);
+            ctx.prune_schedule = &prune_schedule;
+            ctx.prune_sampling = true;
+        }
+        Perf_counters perf_counters;
+        if (perf_mode){
+            perf_counters.open();
+            perf_counters.start();
+            ctx.perf_counters = &perf_counters;
+        }
+        search_catch_signals();
+        ctx.set_control(&control, (int)prefix.size());
+        find_path(&board, path, start_player, &ctx);
+        if (perf_mode){
+            perf_counters.stop();
+            perf_counters.print(ctx.n_nodes);
+        }
+        if (adaptive_pruning)
+            std::cerr << (ctx.prune_sampling ? "stability schedule: not enough samples" : prune_schedule.str()) << std::endl;
+        if (!cache_path.empty()){
+            std::cerr << "cache loaded " << dead_cache.n_loaded << " added " << dead_cache.n_added << " hits " << dead_cache.n_hits << std::endl;
+            dead_cache.save();
+        }
+    }
+    trace_end("search", "search", trace_ts, ctx.n_nodes);
+    if (ctx.shared_table != nullptr)
+        std::cerr << "shared table " << shared_table.str() << " hits " << shared_table.n_hits << " stores " << shared_table.n_stores << std::endl;
     uint64_t elapsed = tim() - strt;
-    std::cout << "found " << n_solutions << " solutions in " << elapsed << " ms " << n_nodes << " nodes" << std::endl;
-    std::cerr << "found " << n_solutions << " solutions in " << elapsed << " ms " << n_nodes << " nodes" << std::endl;
+    if (ctx.stopped){
+        std::cerr << "stopped by " << search_stop_str[control.stop_reason] << " at " << (int)(control.progress() * 1000) / 10.0 << "%, partial results" << std::endl;
+    }
+    if (both_sides){
+        // a full goal is matched by one side only, whatever search found it
+        if (goal_free == 0ULL){
+            ctx.n_solutions_side[goal_player] = ctx.n_solutions;
+            ctx.n_solutions_side[goal_player ^ 1] = 0;
+        }
+        std::cerr << "black to move " << ctx.n_solutions_side[BLACK] << " solutions, white to move " << ctx.n_solutions_side[WHITE] << " solutions" << std::endl;
+    }
+    std::cout << "found " << ctx.n_solutions << " solutions in " << elapsed << " ms " << ctx.n_nodes << " nodes" << std::endl;
+    std::cerr << "found " << ctx.n_solutions << " solutions in " << elapsed << " ms " << ctx.n_nodes << " nodes" << std::endl;
     return 0;
 }
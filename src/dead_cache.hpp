@@ -0,0 +1,299 @@
+/*
+    Reverse Othello
+
+    @file dead_cache.hpp
+        Persistent cache of subtree results across runs
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#include "mapped_file.hpp"
+#include "trace.hpp"
+#ifdef _WIN32
+    #include <process.h>
+    #define dead_cache_getpid _getpid
+#else
+    #include <unistd.h>
+    #define dead_cache_getpid getpid
+#endif
+
+#define DEAD_CACHE_MAGIC "RODEAD1"
+
+// positions with fewer remaining moves are neither looked up nor stored
+#define DEAD_CACHE_MIN_PLIES 8
+
+// subtrees smaller than this are not stored
+#define DEAD_CACHE_MIN_NODES 4096
+
+// default upper bound of entries in the file
+#define DEAD_CACHE_DEFAULT_ENTRIES (1 << 20)
+
+/*
+    @brief Cache file header
+
+    followed by n_entries Dead_cache_entry sorted by (goal_key, black, white, player)
+
+    @param magic                DEAD_CACHE_MAGIC
+    @param n_entries            number of entries
+*/
+struct Dead_cache_header{
+    char magic[8];
+    uint64_t n_entries;
+};
+
+/*
+    @brief Cache file entry
+
+    @param goal_key             key of the goal
+    @param black                black discs
+    @param white                white discs
+    @param n_solutions          solutions below the position (0: dead)
+    @param n_nodes              nodes of the subtree, the work saved by the entry
+    @param player               side to move
+*/
+struct Dead_cache_entry{
+    uint64_t goal_key;
+    uint64_t black;
+    uint64_t white;
+    uint64_t n_solutions;
+    uint64_t n_nodes;
+    uint32_t player;
+    uint32_t reserved;
+
+    bool operator<(const Dead_cache_entry &another) const{
+        if (goal_key != another.goal_key)
+            return goal_key < another.goal_key;
+        if (black != another.black)
+            return black < another.black;
+        if (white != another.white)
+            return white < another.white;
+        return player < another.player;
+    }
+};
+
+/*
+    @brief Cached result of a position
+
+    @param n_solutions          solutions below the position (0: dead)
+    @param n_nodes              nodes of the subtree
+*/
+struct Dead_cache_value{
+    uint64_t n_solutions;
+    uint64_t n_nodes;
+};
+
+/*
+    @brief key of a goal
+
+    @param goal_black           black discs of the goal
+    @param goal_white           white discs of the goal
+    @param goal_free            cells of the goal with any content
+    @param goal_player          side to move of the goal
+    @return 64-bit key
+*/
+inline uint64_t dead_cache_goal_key(uint64_t goal_black, uint64_t goal_white, uint64_t goal_free, int goal_player){
+    uint64_t key = hash_compact_state(Compact_state{goal_black, goal_white});
+    return hash_compact_state(Compact_state{key ^ goal_free, (uint64_t)goal_player});
+}
+
+/*
+    @brief Persistent cache of subtree results of one goal
+
+    The file is mapped read-only at startup and only the entries of the goal are loaded,
+    so concurrent processes can share it. Results found in the run are used at once,
+    and merged into the file at the end. When the file is full,
+    the entries with the smallest subtrees are evicted first.
+    The file is replaced by a rename, so readers never see a partial file.
+
+    In memory, positions are keyed by the cells of goal_mask with State_encoder.
+
+    @param path                 cache file
+    @param goal_key             key of the goal
+    @param max_entries          upper bound of entries in the file
+    @param encoder              encoder of the positions of the goal
+    @param table                results of the goal for each side to move
+    @param n_loaded             entries loaded from the file
+    @param n_added              entries added in this run
+    @param n_hits               subtrees skipped
+*/
+class Dead_cache{
+    public:
+        std::string path;
+        uint64_t goal_key;
+        uint64_t max_entries;
+        State_encoder encoder;
+        Compact_state_map<Dead_cache_value> table[2];
+        uint64_t n_loaded;
+        uint64_t n_added;
+        uint64_t n_hits;
+
+    public:
+        /*
+            @brief load the entries of a goal
+
+            A missing or invalid file is treated as empty.
+
+            @param p                    cache file
+            @param g_key                key of the goal
+            @param goal_mask            cells that can be occupied in the goal
+            @param max_n                upper bound of entries in the file
+        */
+        void init(const std::string &p, uint64_t g_key, uint64_t goal_mask, uint64_t max_n){
+            uint64_t trace_ts = trace_begin();
+            path = p;
+            goal_key = g_key;
+            max_entries = max_n;
+            encoder.init(goal_mask);
+            table[BLACK].init(&encoder);
+            table[WHITE].init(&encoder);
+            n_loaded = 0;
+            n_added = 0;
+            n_hits = 0;
+            uint64_t n;
+            Mapped_file file;
+            const Dead_cache_entry *entries = open_file(&file, &n);
+            Dead_cache_entry first;
+            memset(&first, 0, sizeof(first));
+            first.goal_key = goal_key;
+            for (const Dead_cache_entry *entry = std::lower_bound(entries, entries + n, first); entry != entries + n && entry->goal_key == goal_key; ++entry){
+                if (!inside(entry->black, entry->white))
+                    continue;
+                Board board{entry->black, entry->white};
+                table[entry->player & 1].assign(encoder.encode(&board), Dead_cache_value{entry->n_solutions, entry->n_nodes});
+                ++n_loaded;
+            }
+            trace_end("load", "cache", trace_ts, n_loaded);
+        }
+
+        /*
+            @brief find a position
+
+            @param black                black discs
+            @param white                white discs
+            @param player               side to move
+            @return result, nullptr if not cached
+        */
+        inline const Dead_cache_value *find(uint64_t black, uint64_t white, int player) const{
+            if (!inside(black, white))
+                return nullptr;
+            Board board{black, white};
+            return table[player].find(encoder.encode(&board));
+        }
+
+        /*
+            @brief store a result found in this run
+
+            @param black                black discs
+            @param white                white discs
+            @param player               side to move
+            @param n_solutions          solutions below the position
+            @param n_nodes              nodes of the subtree
+        */
+        inline void add(uint64_t black, uint64_t white, int player, uint64_t n_solutions, uint64_t n_nodes){
+            if (n_nodes < DEAD_CACHE_MIN_NODES || !inside(black, white))
+                return;
+            size_t n_buckets = table[player].bucket_count();
+            Board board{black, white};
+            if (table[player].emplace(encoder.encode(&board), Dead_cache_value{n_solutions, n_nodes}).second){
+                ++n_added;
+                if (table[player].bucket_count() != n_buckets)
+                    trace_instant("resize", "cache", table[player].bucket_count());
+            }
+        }
+
+        /*
+            @brief merge the results of this run into the file
+
+            @return saved?
+        */
+        bool save(){
+            if (n_added == 0)
+                return true;
+            uint64_t trace_ts = trace_begin();
+            std::vector<Dead_cache_entry> entries;
+            {
+                uint64_t n;
+                Mapped_file file;
+                const Dead_cache_entry *old_entries = open_file(&file, &n);
+                for (uint64_t i = 0; i < n; ++i){
+                    if (old_entries[i].goal_key != goal_key)
+                        entries.emplace_back(old_entries[i]);
+                }
+            }
+            for (int player = 0; player < 2; ++player){
+                auto f = [&](const Compact_state &state, const Dead_cache_value &value){
+                    Board board;
+                    encoder.decode(state, &board);
+                    entries.emplace_back(Dead_cache_entry{goal_key, board.player, board.opponent, value.n_solutions, value.n_nodes, (uint32_t)player, 0});
+                };
+                table[player].for_each(f);
+            }
+            // evict the entries that save the least work
+            if (entries.size() > max_entries){
+                std::nth_element(entries.begin(), entries.begin() + max_entries, entries.end(), [](const Dead_cache_entry &a, const Dead_cache_entry &b){
+                    return a.n_nodes > b.n_nodes;
+                });
+                entries.resize(max_entries);
+            }
+            std::sort(entries.begin(), entries.end());
+            std::string tmp_path = path + ".tmp" + std::to_string(dead_cache_getpid());
+            FILE *out = fopen(tmp_path.c_str(), "wb");
+            if (out == nullptr){
+                std::cerr << "[ERROR] can't open " << tmp_path << std::endl;
+                return false;
+            }
+            Dead_cache_header header;
+            memset(&header, 0, sizeof(header));
+            strncpy(header.magic, DEAD_CACHE_MAGIC, sizeof(header.magic));
+            header.n_entries = entries.size();
+            bool res = fwrite(&header, sizeof(header), 1, out) == 1;
+            res = res && fwrite(entries.data(), sizeof(Dead_cache_entry), entries.size(), out) == entries.size();
+            res = (fclose(out) == 0) && res;
+            if (res && std::rename(tmp_path.c_str(), path.c_str()) != 0){
+                std::remove(path.c_str());
+                res = std::rename(tmp_path.c_str(), path.c_str()) == 0;
+            }
+            if (!res){
+                std::remove(tmp_path.c_str());
+                std::cerr << "[ERROR] can't write " << path << std::endl;
+            }
+            trace_end("save", "cache", trace_ts, entries.size());
+            return res;
+        }
+
+    private:
+        /*
+            @brief the position can be encoded
+
+            A position with discs outside goal_mask never reaches the goal, and is not cached.
+
+            @param black                black discs
+            @param white                white discs
+            @return all discs inside goal_mask?
+        */
+        inline bool inside(uint64_t black, uint64_t white) const{
+            return ((black | white) & ~encoder.goal_mask) == 0ULL;
+        }
+
+        const Dead_cache_entry *open_file(Mapped_file *file, uint64_t *n) const{
+            *n = 0;
+            if (!file->open(path) || file->size < sizeof(Dead_cache_header))
+                return nullptr;
+            const Dead_cache_header *header = (const Dead_cache_header*)file->data;
+            if (strncmp(header->magic, DEAD_CACHE_MAGIC, sizeof(header->magic)) != 0 || file->size != sizeof(Dead_cache_header) + header->n_entries * sizeof(Dead_cache_entry)){
+                std::cerr << "[WARNING] ignore invalid cache " << path << std::endl;
+                return nullptr;
+            }
+            *n = header->n_entries;
+            return (const Dead_cache_entry*)(file->data + sizeof(Dead_cache_header));
+        }
+};
@@ -0,0 +1,174 @@
+/*
+    Reverse Othello
+
+    @file edge_table.hpp
+        Edge line reachability tables
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+
+/*
+    an edge cell can be flipped only along its own edge line,
+    so each edge evolves as a closed 8-cell subsystem driven only by placements on that edge
+    (a placement there may be legal through another direction, so any empty cell can be played by any color)
+
+    edge lines:
+        0: row 8 (bits 0-7)
+        1: row 1 (bits 56-63)
+        2: column h (bits 0, 8, ..., 56)
+        3: column a (bits 7, 15, ..., 63)
+*/
+#define N_EDGE_LINES 4
+#define N_EDGE_CONFIGS 6561 // 3 ^ 8
+#define EDGE_CONFIG_WORDS ((N_EDGE_CONFIGS + 63) / 64)
+#define EDGE_CELLS 0xFF818181818181FFULL
+
+/*
+    @brief flips along an 8-cell line
+
+    @param p                    player bits of the line
+    @param o                    opponent bits of the line
+    @param place                cell to put disc (0 to 7)
+    @return flipped bits
+*/
+inline uint_fast8_t edge_line_flip(uint_fast8_t p, uint_fast8_t o, int place){
+    uint_fast8_t res = 0, f = 0;
+    int i;
+    for (i = place + 1; i < HW && (1 & (o >> i)); ++i)
+        f |= 1 << i;
+    if (i < HW && (1 & (p >> i)))
+        res |= f;
+    f = 0;
+    for (i = place - 1; i >= 0 && (1 & (o >> i)); --i)
+        f |= 1 << i;
+    if (i >= 0 && (1 & (p >> i)))
+        res |= f;
+    return res;
+}
+
+/*
+    @brief extract an edge line
+
+    @param x                    a bitboard
+    @param edge                 edge line index
+    @return 8-bit line
+*/
+inline uint_fast8_t join_edge_line(uint64_t x, int edge){
+    switch (edge){
+        case 0:
+            return join_h_line(x, 0);
+        case 1:
+            return join_h_line(x, HW_M1);
+        case 2:
+            return join_v_line(x, 0);
+        default:
+            return join_v_line(x, HW_M1);
+    }
+}
+
+/*
+    @brief base-3 index of an edge line (0: empty 1: black 2: white)
+
+    @param black                black bits of the line
+    @param white                white bits of the line
+    @return index
+*/
+inline int edge_config_idx(uint_fast8_t black, uint_fast8_t white){
+    return (int)(state_encoding_pow3_byte[black] + 2 * state_encoding_pow3_byte[white]);
+}
+
+/*
+    @brief Edge reachability for a goal
+
+    @param reachable            bitset of edge configurations from which a goal edge is reachable
+*/
+struct Edge_reachability{
+    uint64_t reachable[N_EDGE_LINES][EDGE_CONFIG_WORDS];
+
+    /*
+        @brief build tables for a goal
+
+        A configuration matches the goal if it has the goal discs,
+        and its other discs are on free cells.
+
+        @param goal_black           black discs of the goal
+        @param goal_white           white discs of the goal
+        @param goal_free            cells of the goal with any content
+    */
+    void init(uint64_t goal_black, uint64_t goal_white, uint64_t goal_free = 0ULL){
+        static uint8_t config_black[N_EDGE_CONFIGS], config_white[N_EDGE_CONFIGS];
+        static int order[N_EDGE_CONFIGS];
+        for (int idx = 0; idx < N_EDGE_CONFIGS; ++idx){
+            int x = idx;
+            config_black[idx] = 0;
+            config_white[idx] = 0;
+            for (int i = 0; i < HW; ++i){
+                if (x % 3 == 1)
+                    config_black[idx] |= 1 << i;
+                else if (x % 3 == 2)
+                    config_white[idx] |= 1 << i;
+                x /= 3;
+            }
+            order[idx] = idx;
+        }
+        // a move only adds discs, so successors have more discs
+        std::sort(order, order + N_EDGE_CONFIGS, [](int a, int b){
+            return pop_count_uint(config_black[a] | config_white[a]) > pop_count_uint(config_black[b] | config_white[b]);
+        });
+        for (int edge = 0; edge < N_EDGE_LINES; ++edge){
+            uint_fast8_t g_black = join_edge_line(goal_black, edge);
+            uint_fast8_t g_white = join_edge_line(goal_white, edge);
+            uint_fast8_t g_mask = g_black | g_white | join_edge_line(goal_free, edge);
+            for (int i = 0; i < EDGE_CONFIG_WORDS; ++i)
+                reachable[edge][i] = 0ULL;
+            for (const int idx: order){
+                uint_fast8_t b = config_black[idx], w = config_white[idx];
+                bool r = (b & g_black) == g_black && (w & g_white) == g_white && ((b | w) & ~g_mask) == 0;
+                uint_fast8_t empties = g_mask & ~(b | w);
+                for (int cell = 0; cell < HW && !r; ++cell){
+                    if (1 & (empties >> cell)){
+                        uint_fast8_t f = edge_line_flip(b, w, cell);
+                        int nxt = edge_config_idx(b ^ f ^ (1 << cell), w ^ f);
+                        r |= is_reachable(edge, nxt);
+                        f = edge_line_flip(w, b, cell);
+                        nxt = edge_config_idx(b ^ f, w ^ f ^ (1 << cell));
+                        r |= is_reachable(edge, nxt);
+                    }
+                }
+                if (r)
+                    reachable[edge][idx >> 6] |= 1ULL << (idx & 63);
+            }
+        }
+    }
+
+    /*
+        @brief check one edge
+
+        @param edge                 edge line index
+        @param idx                  edge configuration index
+        @return goal edge reachable?
+    */
+    inline bool is_reachable(int edge, int idx) const{
+        return 1 & (reachable[edge][idx >> 6] >> (idx & 63));
+    }
+
+    /*
+        @brief check all edges
+
+        @param black                black discs
+        @param white                white discs
+        @return goal reachable on every edge?
+    */
+    inline bool check(uint64_t black, uint64_t white) const{
+        for (int edge = 0; edge < N_EDGE_LINES; ++edge){
+            if (!is_reachable(edge, edge_config_idx(join_edge_line(black, edge), join_edge_line(white, edge))))
+                return false;
+        }
+        return true;
+    }
+};
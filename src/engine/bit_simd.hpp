@@ -516,9 +516,3 @@ inline uint_fast8_t next_bit(uint64_t *x){
         return res;
     }
 #endif
-
-/*
-    @brief bit initialize
-*/
-void bit_init(){
-}
\ No newline at end of file
@@ -16,6 +16,8 @@
 #include <time.h>
 #include <chrono>
 #include <random>
+#include <thread>
+#include <functional>
 #include <string>
 #include "setting.hpp"
 
@@ -59,7 +61,18 @@ inline uint64_t tim(){
     return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
 }
 
-std::mt19937 raw_myrandom(tim());
+/*
+    @brief raw random function
+
+    Each thread seeds its own generator on first use,
+    so nothing runs at startup and threads never share a state.
+
+    @return random 32bit integer
+*/
+inline uint32_t raw_myrandom(){
+    thread_local std::mt19937 engine(tim() ^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+    return engine();
+}
 
 /*
     @brief random function
@@ -11,6 +11,8 @@
 */
 
 #pragma once
+#include <array>
+#include <utility>
 #include "setting.hpp"
 #include "common.hpp"
 #include "bit.hpp"
@@ -22,7 +24,42 @@ union V8DI {
         __m512i v8;
     #endif
 };
-V8DI lrmask[HW2];
+
+/*
+    @brief lane i of lrmask[place]
+
+    lanes 0-3: cells above the place (h, v, d9, d7)
+    lanes 4-7: cells below the place (h, v, d9, d7)
+
+    @param place                a cell
+    @param i                    lane
+    @return mask
+*/
+constexpr uint64_t lrmask_lane(int place, int i){
+    const int x = place % 8, y = place / 8;
+    switch (i){
+        case 0: return (uint64_t)((0xfe << x) & 0xff) << (y * 8);
+        case 1: return ((0x0101010101010101ULL << x) & 0xffffffffffffff00ULL) << (y * 8);
+        case 2: return ((0x8040201008040201ULL >> (x * 8)) & 0xffffffffffffff00ULL) << (y * 8);
+        case 3: return ((0x0102040810204080ULL >> ((7 - x) * 8)) & 0xffffffffffffff00ULL) << (y * 8);
+        case 4: return ((uint64_t)(0x7f >> (7 - x)) << 56) >> ((7 - y) * 8);
+        case 5: return ((0x0101010101010101ULL << x) & 0x00ffffffffffffffULL) >> ((7 - y) * 8);
+        case 6: return ((0x8040201008040201ULL << ((7 - x) * 8)) & 0x00ffffffffffffffULL) >> ((7 - y) * 8);
+        default: return ((0x0102040810204080ULL << (x * 8)) & 0x00ffffffffffffffULL) >> ((7 - y) * 8);
+    }
+}
+
+template <std::size_t... I>
+constexpr std::array<V8DI, HW2> make_lrmask(std::index_sequence<I...>){
+    return {{V8DI{{lrmask_lane(I, 0), lrmask_lane(I, 1), lrmask_lane(I, 2), lrmask_lane(I, 3), lrmask_lane(I, 4), lrmask_lane(I, 5), lrmask_lane(I, 6), lrmask_lane(I, 7)}}...}};
+}
+
+// generated at compile time (at startup with MSVC, which does not reliably fold unions with vector members)
+#ifdef _MSC_VER
+    const std::array<V8DI, HW2> lrmask = make_lrmask(std::make_index_sequence<HW2>{});
+#else
+    constexpr std::array<V8DI, HW2> lrmask = make_lrmask(std::make_index_sequence<HW2>{});
+#endif
 
 /*
     @brief Flip class
@@ -90,30 +127,3 @@ class Flip{
             return flip;
         }
 };
-
-/*
-    @brief Flip initialize
-*/
-void flip_init() {
-    for (int x = 0; x < 8; ++x) {
-        __m256i lmask = _mm256_set_epi64x(
-            (0x0102040810204080ULL >> ((7 - x) * 8)) & 0xffffffffffffff00ULL,
-            (0x8040201008040201ULL >> (x * 8)) & 0xffffffffffffff00ULL,
-            (0x0101010101010101ULL << x) & 0xffffffffffffff00ULL,
-            (0xfe << x) & 0xff
-        );
-        __m256i rmask = _mm256_set_epi64x(
-            (0x0102040810204080ULL << (x * 8)) & 0x00ffffffffffffffULL,
-            (0x8040201008040201ULL << ((7 - x) * 8)) & 0x00ffffffffffffffULL,
-            (0x0101010101010101ULL << x) & 0x00ffffffffffffffULL,
-            (uint64_t)(0x7f >> (7 - x)) << 56
-        );
-
-        for (int y = 0; y < 8; ++y) {
-            lrmask[y * 8 + x].v4[0] = lmask;
-            lrmask[(7 - y) * 8 + x].v4[1] = rmask;
-            lmask = _mm256_slli_epi64(lmask, 8);
-            rmask = _mm256_srli_epi64(rmask, 8);
-        }
-    }
-}
\ No newline at end of file
@@ -15,13 +15,16 @@
 
 
 /*
-    @brief mobility initialize
+    @brief constants for mobility (lanes from lower: h, v, d9, d7)
 */
-__m256i shift1897, mflipH;
-void mobility_init(){
-    shift1897 = _mm256_set_epi64x(7, 9, 8, 1);
-    mflipH = _mm256_set_epi64x(0x7E7E7E7E7E7E7E7E, 0x7E7E7E7E7E7E7E7E, -1, 0x7E7E7E7E7E7E7E7E);
-}
+#ifdef _MSC_VER
+    // MSVC's __m256i is a union of byte arrays, brace initialization would set bytes
+    const __m256i shift1897 = _mm256_set_epi64x(7, 9, 8, 1);
+    const __m256i mflipH = _mm256_set_epi64x(0x7E7E7E7E7E7E7E7E, 0x7E7E7E7E7E7E7E7E, -1, 0x7E7E7E7E7E7E7E7E);
+#else
+    constexpr __m256i shift1897 = {1, 8, 9, 7};
+    constexpr __m256i mflipH = {0x7E7E7E7E7E7E7E7E, -1, 0x7E7E7E7E7E7E7E7E, 0x7E7E7E7E7E7E7E7E};
+#endif
 
 /*
     @brief Get a bitboard representing all legal moves
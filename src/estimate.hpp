@@ -0,0 +1,155 @@
+/*
+    Reverse Othello
+
+    @file estimate.hpp
+        Monte Carlo estimation of the search tree size
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <cmath>
+#include "engine/board.hpp"
+#include "search.hpp"
+
+// z value of 95% confidence interval
+#define ESTIMATE_Z95 1.96
+
+/*
+    @brief running mean and variance (Welford)
+*/
+struct Estimate_stat{
+    uint64_t n;
+    double mean;
+    double m2;
+
+    Estimate_stat() : n(0), mean(0.0), m2(0.0){}
+
+    inline void add(double x){
+        ++n;
+        double delta = x - mean;
+        mean += delta / n;
+        m2 += delta * (x - mean);
+    }
+
+    /*
+        @brief half width of the 95% confidence interval of the mean
+    */
+    inline double ci95() const{
+        if (n < 2)
+            return INFINITY;
+        return ESTIMATE_Z95 * sqrt(m2 / (n - 1) / n);
+    }
+};
+
+/*
+    @brief Estimation result
+
+    @param n_probes             number of probes
+    @param nodes                estimated nodes
+    @param solutions            estimated solutions
+    @param ms_per_node          measured time per node
+    @param elapsed              time used for estimation
+*/
+struct Estimate_result{
+    Estimate_stat nodes;
+    Estimate_stat solutions;
+    double ms_per_node;
+    uint64_t elapsed;
+};
+
+/*
+    @brief one random root-to-leaf probe through the pruned find_path tree (Knuth's estimator)
+
+    Every node on the probe is weighted by the product of the branching factors above it,
+    which is an unbiased estimate of the number of nodes in that depth.
+
+    @param board                root board
+    @param player               side to move at the root
+    @param ctx                  search context
+    @param est_nodes            estimated nodes
+    @param est_solutions        estimated solutions
+    @return number of nodes visited by this probe
+*/
+uint64_t estimate_probe(Board board, int player, const Path_context *ctx, double *est_nodes, double *est_solutions){
+    double weight = 1.0;
+    uint64_t n_probe_nodes = 0;
+    *est_nodes = 0.0;
+    *est_solutions = 0.0;
+    Flip flip;
+    Flip children[HW2];
+    while (true){
+        ++n_probe_nodes;
+        *est_nodes += weight;
+        const bool same_side = player == ctx->goal_player;
+        if (ctx->match(&board, same_side)){
+            *est_solutions += weight;
+            if (ctx->free_mask == 0ULL)
+                break;
+        }
+        if (stability_cut(&board, ctx->goal_mask, ctx->goal_board_player[same_side], ctx->goal_board_opponent[same_side]))
+            break;
+        uint64_t legal = board.get_legal() & ctx->goal_mask & ~(ctx->corner_mask & ctx->goal_board_opponent[same_side]);
+        int n_children = 0;
+        for (uint_fast8_t cell = first_bit(&legal); legal; cell = next_bit(&legal)){
+            calc_flip(&flip, &board, cell);
+            if (flip.flip & ctx->corner_mask)
+                continue;
+            board.move_board(&flip);
+            if (!edge_cut(&board, player, cell, &ctx->edge_reachability))
+                children[n_children++] = flip;
+            board.undo_board(&flip);
+        }
+        if (n_children == 0)
+            break;
+        weight *= n_children;
+        board.move_board(&children[myrandrange(0, n_children)]);
+        player ^= 1;
+    }
+    return n_probe_nodes;
+}
+
+/*
+    @brief estimate the search within a time budget
+
+    @param board                root board
+    @param player               side to move at the root
+    @param ctx                  search context
+    @param time_limit           time budget in ms
+    @return estimation result
+*/
+Estimate_result estimate_path(Board board, int player, const Path_context *ctx, uint64_t time_limit){
+    Estimate_result res;
+    uint64_t strt = tim();
+    uint64_t n_probe_nodes = 0;
+    double est_nodes, est_solutions;
+    do {
+        // check the clock every 64 probes
+        for (int i = 0; i < 64; ++i){
+            n_probe_nodes += estimate_probe(board, player, ctx, &est_nodes, &est_solutions);
+            res.nodes.add(est_nodes);
+            res.solutions.add(est_solutions);
+        }
+        res.elapsed = tim() - strt;
+    } while (res.elapsed < time_limit);
+    // a probe expands every child of each node on it, which is the work find_path does per node
+    res.ms_per_node = (double)res.elapsed / n_probe_nodes;
+    return res;
+}
+
+/*
+    @brief print an estimation result
+
+    @param res                  estimation result
+*/
+void print_estimate(const Estimate_result &res){
+    double nodes_ci = res.nodes.ci95();
+    double solutions_ci = res.solutions.ci95();
+    std::cout << "estimated with " << res.nodes.n << " probes in " << res.elapsed << " ms" << std::endl;
+    std::cout << std::scientific << std::setprecision(3);
+    std::cout << "nodes " << res.nodes.mean << " [" << std::max(0.0, res.nodes.mean - nodes_ci) << ", " << res.nodes.mean + nodes_ci << "]" << std::endl;
+    std::cout << "solutions " << res.solutions.mean << " [" << std::max(0.0, res.solutions.mean - solutions_ci) << ", " << res.solutions.mean + solutions_ci << "]" << std::endl;
+    std::cout << "time_ms " << res.nodes.mean * res.ms_per_node << " [" << std::max(0.0, res.nodes.mean - nodes_ci) * res.ms_per_node << ", " << (res.nodes.mean + nodes_ci) * res.ms_per_node << "]" << std::endl;
+    std::cout << std::defaultfloat;
+}
@@ -0,0 +1,91 @@
+/*
+    Reverse Othello
+
+    @file flip_all.hpp
+        Flips of all moves of a board at once
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include "engine/bit.hpp"
+#include "engine/setting.hpp"
+#include "engine/mobility.hpp"
+#include "engine/flip.hpp"
+
+/*
+    @brief outflankable opponent discs of every direction
+
+    Same propagation as calc_legal, keeping the chains of opponent discs
+    connected to a player disc instead of reducing them to legal moves.
+
+    @param P                    a bitboard representing player
+    @param O                    a bitboard representing opponent
+    @param chain_l              opponent chains grown to upper bits from player discs (h, v, d9, d7)
+    @param chain_r              opponent chains grown to lower bits from player discs (h, v, d9, d7)
+    @return all legal moves as a bitboard
+*/
+inline uint64_t calc_legal_chain(const uint64_t P, const uint64_t O, __m256i *chain_l, __m256i *chain_r){
+    __m256i	PP, mOO, MM, flip_l, flip_r, pre_l, pre_r, shift2;
+    __m128i	M;
+    PP = _mm256_broadcastq_epi64(_mm_cvtsi64_si128(P));
+    mOO = _mm256_and_si256(_mm256_broadcastq_epi64(_mm_cvtsi64_si128(O)), mflipH);
+    flip_l = _mm256_and_si256(mOO, _mm256_sllv_epi64(PP, shift1897));
+    flip_r = _mm256_and_si256(mOO, _mm256_srlv_epi64(PP, shift1897));
+    flip_l = _mm256_or_si256(flip_l, _mm256_and_si256(mOO, _mm256_sllv_epi64(flip_l, shift1897)));
+    flip_r = _mm256_or_si256(flip_r, _mm256_and_si256(mOO, _mm256_srlv_epi64(flip_r, shift1897)));
+    pre_l = _mm256_and_si256(mOO, _mm256_sllv_epi64(mOO, shift1897));
+    pre_r = _mm256_srlv_epi64(pre_l, shift1897);
+    shift2 = _mm256_add_epi64(shift1897, shift1897);
+    flip_l = _mm256_or_si256(flip_l, _mm256_and_si256(pre_l, _mm256_sllv_epi64(flip_l, shift2)));
+    flip_r = _mm256_or_si256(flip_r, _mm256_and_si256(pre_r, _mm256_srlv_epi64(flip_r, shift2)));
+    flip_l = _mm256_or_si256(flip_l, _mm256_and_si256(pre_l, _mm256_sllv_epi64(flip_l, shift2)));
+    flip_r = _mm256_or_si256(flip_r, _mm256_and_si256(pre_r, _mm256_srlv_epi64(flip_r, shift2)));
+    *chain_l = flip_l;
+    *chain_r = flip_r;
+    MM = _mm256_sllv_epi64(flip_l, shift1897);
+    MM = _mm256_or_si256(MM, _mm256_srlv_epi64(flip_r, shift1897));
+    M = _mm_or_si128(_mm256_castsi256_si128(MM), _mm256_extracti128_si256(MM, 1));
+    M = _mm_or_si128(M, _mm_unpackhi_epi64(M, M));
+    return _mm_cvtsi128_si64(M) & ~(P | O);
+}
+
+/*
+    @brief flips of all given moves in one pass
+
+    The chains are calculated once, and a move flips, in each direction,
+    the chain discs next to it up to the first cell outside the chain.
+
+    @param moves                moves to calculate (must be legal)
+    @param chain_l              chains from calc_legal_chain
+    @param chain_r              chains from calc_legal_chain
+    @param flips                array to store (pos, flip) pairs
+    @return number of moves
+*/
+inline int calc_flip_all(uint64_t moves, const __m256i chain_l, const __m256i chain_r, Flip flips[]){
+    int n = 0;
+    const __m256i shift2 = _mm256_add_epi64(shift1897, shift1897);
+    const __m256i shift4 = _mm256_add_epi64(shift2, shift2);
+    for (uint_fast8_t cell = first_bit(&moves); moves; cell = next_bit(&moves)){
+        // upper bits: chains grown downward from player discs, contiguous from the move
+        __m256i mask = lrmask[cell].v4[0];
+        __m256i seg = _mm256_and_si256(mask, chain_r);
+        __m256i gap = _mm256_andnot_si256(chain_r, mask);
+        gap = _mm256_and_si256(gap, _mm256_sub_epi64(_mm256_setzero_si256(), gap)); // LS1B
+        __m256i flip4 = _mm256_and_si256(seg, _mm256_add_epi64(gap, _mm256_set1_epi64x(-1)));
+        // lower bits: chains grown upward, cut below the first cell outside the chain
+        mask = lrmask[cell].v4[1];
+        seg = _mm256_and_si256(mask, chain_l);
+        gap = _mm256_andnot_si256(chain_l, mask);
+        gap = _mm256_or_si256(gap, _mm256_srlv_epi64(gap, shift1897));
+        gap = _mm256_or_si256(gap, _mm256_srlv_epi64(gap, shift2));
+        gap = _mm256_or_si256(gap, _mm256_srlv_epi64(gap, shift4));
+        flip4 = _mm256_or_si256(flip4, _mm256_andnot_si256(gap, seg));
+        __m128i flip2 = _mm_or_si128(_mm256_castsi256_si128(flip4), _mm256_extracti128_si256(flip4, 1));
+        flips[n].pos = cell;
+        flips[n].flip = _mm_cvtsi128_si64(_mm_or_si128(flip2, _mm_unpackhi_epi64(flip2, flip2)));
+        ++n;
+    }
+    return n;
+}
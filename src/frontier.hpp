@@ -0,0 +1,274 @@
+/*
+    Reverse Othello
+
+    @file frontier.hpp
+        Breadth-first frontier with merged transpositions, then parallel depth-first search
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <unordered_map>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#include "search.hpp"
+
+// approximate bytes per frontier node (board, count, hash entry and parent edges)
+#define FRONTIER_NODE_BYTES 96
+
+/*
+    @brief Move from a node of the previous level
+
+    @param parent               index of the parent in the previous level
+    @param move                 cell of the move
+    @param child                index of the child in this level
+*/
+struct Frontier_edge{
+    uint32_t parent;
+    uint32_t move;
+    uint32_t child;
+};
+
+/*
+    @brief One level of the frontier
+
+    @param boards               unique positions (player is the side to move)
+    @param n_prefixes           number of paths from the start to each position
+    @param edges                moves reaching each position, sorted by child
+    @param edge_begin           first edge of each position (size boards.size() + 1)
+*/
+struct Frontier_level{
+    std::vector<Board> boards;
+    std::vector<uint64_t> n_prefixes;
+    std::vector<Frontier_edge> edges;
+    std::vector<uint32_t> edge_begin;
+};
+
+/*
+    @brief Frontier search
+
+    The first plies are expanded level by level with the pruning of find_path,
+    merging the paths that reach the same position. Each unique position of the
+    last level is then searched by find_path in parallel, and its solutions count
+    once for every path that reaches it.
+
+    @param levels               levels from the start (levels[0] is the start)
+    @param keep_edges           keep the moves to rebuild the prefixes
+    @param suffixes             paths found below each position of the last level
+    @param n_suffixes           number of paths found below each position of the last level
+    @param n_nodes              number of visited nodes
+    @param n_solutions          number of solutions
+*/
+struct Frontier_search{
+    std::vector<Frontier_level> levels;
+    bool keep_edges;
+    std::vector<std::vector<std::vector<int>>> suffixes;
+    std::vector<uint64_t> n_suffixes;
+    uint64_t n_nodes;
+    uint64_t n_solutions;
+
+    /*
+        @brief build the frontier
+
+        Levels are added while all of them fit in the memory budget, and never past
+        n_left_min moves before the last move before the goal. The expansion of a level
+        stops as soon as it passes the budget, so the budget is never exceeded by more than a node.
+
+        @param start                start board (player is the side to move)
+        @param start_player         side to move of the start board
+        @param n_prefix             length of the path given with the start board
+        @param ctx                  search context (not a pattern)
+        @param memory_budget        memory budget in bytes
+        @param edges                keep the moves to rebuild the prefixes
+        @param n_left_min           moves left at least below the last level
+    */
+    void init(const Board *start, int start_player, int n_prefix, const Path_context *ctx, uint64_t memory_budget, bool edges, int n_left_min){
+        keep_edges = edges;
+        levels.assign(1, Frontier_level());
+        levels[0].boards.emplace_back(*start);
+        levels[0].n_prefixes.emplace_back(1);
+        levels[0].edge_begin.assign(2, 0);
+        n_nodes = 1;
+        n_solutions = 0;
+        // levels are keyed by the cells of goal_mask, a start with other discs has no solution
+        if ((start->player | start->opponent) & ~ctx->goal_mask)
+            return;
+        int player = start_player;
+        uint64_t memory = FRONTIER_NODE_BYTES;
+        while (n_prefix + (int)levels.size() - 1 < ctx->last_ply - n_left_min){
+            Frontier_level next;
+            uint64_t trace_ts = trace_begin();
+            // a level that doesn't fit is dropped as soon as it passes the budget
+            bool fits = memory < memory_budget && expand(levels.back(), player, ctx, &next, memory_budget - memory);
+            trace_end("level", "frontier", trace_ts, next.boards.size());
+            if (!fits)
+                break;
+            memory += level_bytes(next);
+            n_nodes += next.boards.size();
+            levels.emplace_back(std::move(next));
+            player ^= 1;
+            if (levels.back().boards.empty())
+                break;
+        }
+    }
+
+    /*
+        @brief side to move of the last level
+
+        @param start_player         side to move of the start board
+        @return side to move
+    */
+    inline int frontier_player(int start_player) const{
+        return start_player ^ ((levels.size() - 1) & 1);
+    }
+
+    /*
+        @brief search every position of the last level with threads
+
+        @param start_player         side to move of the start board
+        @param n_prefix             length of the path given with the start board
+        @param ctx                  search context (not a pattern)
+        @param n_threads            number of threads
+    */
+    void search(int start_player, int n_prefix, const Path_context *ctx, int n_threads){
+        const Frontier_level &frontier = levels.back();
+        const int player = frontier_player(start_player);
+        const int depth = n_prefix + (int)levels.size() - 1;
+        suffixes.assign(keep_edges ? frontier.boards.size() : 0, std::vector<std::vector<int>>());
+        n_suffixes.assign(frontier.boards.size(), 0);
+        std::atomic<size_t> next_node(0);
+        std::atomic<uint64_t> n_nodes_all(0);
+        auto worker = [&](){
+            Path_context thread_ctx = *ctx;
+            thread_ctx.output_mode = keep_edges ? PATH_OUTPUT_STORE : PATH_OUTPUT_COUNT;
+            thread_ctx.dead_cache = nullptr;
+            thread_ctx.prune_schedule = nullptr;
+            thread_ctx.perf_counters = nullptr;
+            thread_ctx.set_control(nullptr, 0);
+            thread_ctx.n_nodes = 0;
+            // only the length of the path is used by find_path
+            std::vector<int> path(depth, 0);
+            size_t i;
+            while ((i = next_node.fetch_add(1)) < frontier.boards.size()){
+                thread_ctx.paths.clear();
+                thread_ctx.n_solutions = 0;
+                Board board = frontier.boards[i];
+                uint64_t trace_ts = trace_begin();
+                find_path(&board, path, player, &thread_ctx);
+                trace_end("subtree", "frontier", trace_ts, i);
+                n_suffixes[i] = thread_ctx.n_solutions;
+                if (keep_edges){
+                    for (std::vector<int> &p: thread_ctx.paths)
+                        p.erase(p.begin(), p.begin() + depth);
+                    suffixes[i].swap(thread_ctx.paths);
+                }
+            }
+            // the root of each search is a frontier node, counted when the level was built
+            n_nodes_all += thread_ctx.n_nodes;
+        };
+        std::vector<std::thread> threads;
+        for (int i = 1; i < n_threads; ++i)
+            threads.emplace_back(worker);
+        worker();
+        for (std::thread &thread: threads)
+            thread.join();
+        n_nodes += n_nodes_all - frontier.boards.size();
+        for (size_t i = 0; i < frontier.boards.size(); ++i)
+            n_solutions += frontier.n_prefixes[i] * n_suffixes[i];
+    }
+
+    /*
+        @brief call f with every path from the start to a position
+
+        @param level                level of the position
+        @param idx                  index of the position in the level
+        @param path                 moves after the position, in reverse order
+        @param f                    function called with each path
+    */
+    template <typename F>
+    void for_each_prefix(int level, uint32_t idx, std::vector<int> &path, F &f) const{
+        if (level == 0){
+            f(path);
+            return;
+        }
+        const Frontier_level &l = levels[level];
+        for (uint32_t e = l.edge_begin[idx]; e < l.edge_begin[idx + 1]; ++e){
+            path.emplace_back(l.edges[e].move);
+                for_each_prefix(level - 1, l.edges[e].parent, path, f);
+            path.pop_back();
+        }
+    }
+
+    private:
+        /*
+            @brief approximate memory of a level
+
+            @param level                level
+            @return bytes
+        */
+        static inline uint64_t level_bytes(const Frontier_level &level){
+            return level.boards.size() * FRONTIER_NODE_BYTES + level.edges.size() * sizeof(Frontier_edge);
+        }
+
+        /*
+            @brief add the unique children of a level
+
+            @param level                level to expand
+            @param player               side to move of the level
+            @param ctx                  search context
+            @param next                 next level to store
+            @param memory_budget        memory budget of the next level in bytes
+            @return the next level fits in the budget? (if not, it is incomplete)
+        */
+        bool expand(const Frontier_level &level, int player, const Path_context *ctx, Frontier_level *next, uint64_t memory_budget) const{
+            const bool same_side = player == ctx->goal_player;
+            const uint64_t goal_board_player = ctx->goal_board_player[same_side];
+            const uint64_t goal_board_opponent = ctx->goal_board_opponent[same_side];
+            // every position has its discs inside goal_mask
+            State_encoder encoder;
+            encoder.init(ctx->goal_mask);
+            Compact_state_map<uint32_t> index;
+            index.init(&encoder);
+            index.reserve(level.boards.size() * 4);
+            Flip flip;
+            for (uint32_t i = 0; i < (uint32_t)level.boards.size(); ++i){
+                Board board = level.boards[i];
+                if (stability_cut(&board, ctx->goal_mask, goal_board_player, goal_board_opponent))
+                    continue;
+                uint64_t legal = board.get_legal() & ctx->goal_mask & ~(ctx->corner_mask & goal_board_opponent);
+                for (uint_fast8_t cell = first_bit(&legal); legal; cell = next_bit(&legal)){
+                    calc_flip(&flip, &board, cell);
+                    if (flip.flip & ctx->corner_mask)
+                        continue;
+                    board.move_board(&flip);
+                    if (!edge_cut(&board, player, cell, &ctx->edge_reachability)){
+                        auto elem = index.emplace(encoder.encode(&board), (uint32_t)next->boards.size());
+                        if (elem.second){
+                            next->boards.emplace_back(board);
+                            next->n_prefixes.emplace_back(0);
+                        }
+                        next->n_prefixes[*elem.first] += level.n_prefixes[i];
+                        if (keep_edges)
+                            next->edges.emplace_back(Frontier_edge{i, cell, *elem.first});
+                        if (level_bytes(*next) > memory_budget)
+                            return false;
+                    }
+                    board.undo_board(&flip);
+                }
+            }
+            std::stable_sort(next->edges.begin(), next->edges.end(), [](const Frontier_edge &a, const Frontier_edge &b){
+                return a.child < b.child;
+            });
+            next->edge_begin.assign(next->boards.size() + 1, 0);
+            for (const Frontier_edge &edge: next->edges)
+                ++next->edge_begin[edge.child + 1];
+            for (size_t i = 0; i < next->boards.size(); ++i)
+                next->edge_begin[i + 1] += next->edge_begin[i];
+            return true;
+        }
+};
@@ -0,0 +1,99 @@
+/*
+    Reverse Othello
+
+    @file frozen_analysis.hpp
+        Per-direction flippability analysis of the goal
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include "engine/board.hpp"
+
+/*
+    directions:
+        0: horizontal
+        1: vertical
+        2: d7 (a8-h1)
+        3: d9 (a1-h8)
+*/
+#define N_LINE_DIRECTIONS 4
+
+/*
+    @brief cells adjacent to x along a direction (both sides)
+
+    @param x                    a bitboard
+    @param dir                  direction
+    @param res_l                cells whose lower neighbor is in x
+    @param res_r                cells whose upper neighbor is in x
+*/
+inline void line_neighbors(uint64_t x, int dir, uint64_t *res_l, uint64_t *res_r){
+    switch (dir){
+        case 0:
+            *res_l = (x << 1) & 0xFEFEFEFEFEFEFEFEULL;
+            *res_r = (x >> 1) & 0x7F7F7F7F7F7F7F7FULL;
+            break;
+        case 1:
+            *res_l = x << 8;
+            *res_r = x >> 8;
+            break;
+        case 2:
+            *res_l = (x << 7) & 0x7F7F7F7F7F7F7F7FULL;
+            *res_r = (x >> 7) & 0xFEFEFEFEFEFEFEFEULL;
+            break;
+        default:
+            *res_l = (x << 9) & 0xFEFEFEFEFEFEFEFEULL;
+            *res_r = (x >> 9) & 0x7F7F7F7F7F7F7F7FULL;
+            break;
+    }
+}
+
+/*
+    @brief Frozen square analysis
+
+    A square is flipped along a direction only if both neighbors along it are occupied,
+    and a neighbor that is never flipped must be the placed disc or the outflanking disc,
+    so the square can be flipped along that direction only to the neighbor's goal color.
+    A square that can never be flipped to its goal color is frozen:
+    it must be placed with its goal color and never flipped afterwards.
+    Free squares may end up empty or with either color, so they are never frozen
+    and are treated as possibly occupied neighbors.
+
+    @param flippable            squares that can be flipped along each direction
+    @param frozen               squares that are never flipped in any solution
+*/
+struct Frozen_analysis{
+    uint64_t flippable[N_LINE_DIRECTIONS];
+    uint64_t frozen;
+
+    /*
+        @brief analyze a goal
+
+        @param goal_a               discs of one color in the goal
+        @param goal_b               discs of the other color in the goal
+        @param goal_free            squares of the goal with any content
+    */
+    void init(uint64_t goal_a, uint64_t goal_b, uint64_t goal_free = 0ULL){
+        uint64_t goal_mask = goal_a | goal_b | goal_free;
+        uint64_t l, r;
+        for (int dir = 0; dir < N_LINE_DIRECTIONS; ++dir){
+            line_neighbors(goal_mask, dir, &l, &r);
+            flippable[dir] = goal_mask & l & r;
+        }
+        frozen = 0ULL;
+        uint64_t n_frozen = (goal_a | goal_b) & ~(flippable[0] | flippable[1] | flippable[2] | flippable[3]);
+        while (n_frozen != frozen){
+            frozen = n_frozen;
+            uint64_t to_a = 0ULL, to_b = 0ULL;
+            for (int dir = 0; dir < N_LINE_DIRECTIONS; ++dir){
+                uint64_t near_a_l, near_a_r, near_b_l, near_b_r;
+                line_neighbors(frozen & goal_a, dir, &near_a_l, &near_a_r);
+                line_neighbors(frozen & goal_b, dir, &near_b_l, &near_b_r);
+                to_a |= flippable[dir] & ~(near_b_l | near_b_r);
+                to_b |= flippable[dir] & ~(near_a_l | near_a_r);
+            }
+            n_frozen = frozen | (goal_a & ~to_a) | (goal_b & ~to_b);
+        }
+    }
+};
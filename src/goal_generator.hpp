@@ -0,0 +1,125 @@
+/*
+    Reverse Othello
+
+    @file goal_generator.hpp
+        Reproducible corpus of goals with known transcripts
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <cmath>
+#include "engine/board.hpp"
+#include "engine/util.hpp"
+
+// games that hit a pass before the target move are played again, at most this many times per goal
+#define GOAL_GENERATOR_MAX_RETRY 1000
+
+/*
+    @brief a board in the input format (X: black O: white)
+
+    @param black                black discs
+    @param white                white discs
+    @param player               side to move
+    @return 64 cells and the side to move
+*/
+inline std::string board_line(uint64_t black, uint64_t white, int player){
+    std::string res(HW2, '-');
+    for (int i = 0; i < HW2; ++i){
+        if (1 & (black >> (HW2_M1 - i)))
+            res[i] = 'X';
+        else if (1 & (white >> (HW2_M1 - i)))
+            res[i] = 'O';
+    }
+    res += player == BLACK ? " X" : " O";
+    return res;
+}
+
+/*
+    @brief play a random game without passes
+
+    Each legal move is chosen with weight (number of flipped discs)^(-bias),
+    so bias = 0 is uniform, bias > 0 prefers quiet moves and bias < 0 prefers greedy moves.
+
+    @param board                board to start from (player is the side to move), updated
+    @param player               side to move (BLACK / WHITE), updated
+    @param n_moves              number of moves to play
+    @param bias                 bias toward moves flipping few discs
+    @param engine               random generator
+    @param moves                vector to append the moves to
+    @return played n_moves without a pass?
+*/
+bool generate_game(Board *board, int *player, int n_moves, double bias, std::mt19937_64 &engine, std::vector<int> &moves){
+    Flip flips[HW2];
+    double weights[HW2];
+    for (int ply = 0; ply < n_moves; ++ply){
+        uint64_t legal = board->get_legal();
+        if (legal == 0ULL)
+            return false;
+        int n_children = 0;
+        for (uint_fast8_t cell = first_bit(&legal); legal; cell = next_bit(&legal)){
+            calc_flip(&flips[n_children], board, cell);
+            weights[n_children] = pow((double)pop_count_ull(flips[n_children].flip), -bias);
+            ++n_children;
+        }
+        // std::discrete_distribution is implementation-defined, the walk on the weights is portable
+        double total = 0.0;
+        for (int i = 0; i < n_children; ++i)
+            total += weights[i];
+        double r = (double)(engine() >> 11) * (1.0 / 9007199254740992.0) * total;
+        int idx = 0;
+        while (idx < n_children - 1 && r >= weights[idx]){
+            r -= weights[idx];
+            ++idx;
+        }
+        const Flip *flip = &flips[idx];
+        board->move_board(flip);
+        *player ^= 1;
+        moves.emplace_back(flip->pos);
+    }
+    return true;
+}
+
+/*
+    @brief Goal generator
+
+    The n-th goal depends only on the seed and n, so a corpus is reproducible
+    and a prefix of a larger corpus is the smaller corpus.
+
+    @param seed                 random seed
+    @param n_moves              number of moves played from the start to each goal
+    @param bias                 bias toward moves flipping few discs
+*/
+struct Goal_generator{
+    uint64_t seed;
+    int n_moves;
+    double bias;
+
+    /*
+        @brief generate a goal
+
+        @param idx                  goal index
+        @param start                start board (player is the side to move)
+        @param start_player         side to move of the start board
+        @param goal                 goal to store (player is the side to move)
+        @param goal_player          side to move of the goal to store
+        @param moves                moves from the start to the goal to store
+        @return generated?
+    */
+    bool generate(uint64_t idx, const Board *start, int start_player, Board *goal, int *goal_player, std::vector<int> &moves) const{
+        std::seed_seq seq{(uint32_t)seed, (uint32_t)(seed >> 32), (uint32_t)idx, (uint32_t)(idx >> 32)};
+        std::mt19937_64 engine(seq);
+        for (int i = 0; i < GOAL_GENERATOR_MAX_RETRY; ++i){
+            *goal = *start;
+            *goal_player = start_player;
+            moves.clear();
+            if (generate_game(goal, goal_player, n_moves, bias, engine, moves))
+                return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,135 @@
+/*
+    Reverse Othello
+
+    @file mapped_file.hpp
+        Memory-mapped file
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <cstdint>
+#ifdef _WIN32
+    // keep std::min and std::max usable
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+/*
+    @brief Read-only memory-mapped file
+
+    @param data                 mapped bytes (nullptr if not opened)
+    @param size                 number of bytes
+*/
+class Mapped_file{
+    public:
+        const uint8_t *data;
+        uint64_t size;
+
+    private:
+    #ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+    #else
+        int fd;
+    #endif
+
+    public:
+        Mapped_file(){
+            data = nullptr;
+            size = 0;
+        #ifdef _WIN32
+            file = INVALID_HANDLE_VALUE;
+            mapping = NULL;
+        #else
+            fd = -1;
+        #endif
+        }
+
+        ~Mapped_file(){
+            close();
+        }
+
+        Mapped_file(const Mapped_file&) = delete;
+        Mapped_file &operator=(const Mapped_file&) = delete;
+
+        /*
+            @brief map a file
+
+            @param path                 file path
+            @return mapped?
+        */
+        bool open(const std::string &path){
+            close();
+        #ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0){
+                close();
+                return false;
+            }
+            size = (uint64_t)file_size.QuadPart;
+            mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mapping == NULL){
+                close();
+                return false;
+            }
+            data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        #else
+            fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0 || st.st_size == 0){
+                close();
+                return false;
+            }
+            size = (uint64_t)st.st_size;
+            void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            data = p == MAP_FAILED ? nullptr : (const uint8_t*)p;
+        #endif
+            if (data == nullptr){
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        /*
+            @brief unmap the file
+        */
+        void close(){
+        #ifdef _WIN32
+            if (data != nullptr)
+                UnmapViewOfFile(data);
+            if (mapping != NULL)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            mapping = NULL;
+            file = INVALID_HANDLE_VALUE;
+        #else
+            if (data != nullptr)
+                munmap((void*)data, size);
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        #endif
+            data = nullptr;
+            size = 0;
+        }
+};
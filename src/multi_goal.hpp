@@ -0,0 +1,230 @@
+/*
+    Reverse Othello
+
+    @file multi_goal.hpp
+        Shared search for goals with the same or nested occupancy
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#include "edge_table.hpp"
+#include "frozen_analysis.hpp"
+#include "search.hpp"
+
+// goals searched in one traversal (one bit each)
+#define MULTI_GOAL_MAX 64
+
+// goals with nested occupancies are searched together if they differ by at most this many discs;
+// with larger differences the weaker stability of the union costs more than the shared nodes save
+#define MULTI_GOAL_NEST_DISCS 1
+
+/*
+    @brief Goals searched in one traversal
+
+    A refutation found at a node (a stable disc of the wrong color, a flipped frozen disc,
+    an unreachable edge) is applied to every goal of the batch at once.
+    Goals may have different occupancies: stability is calculated with the union of
+    the occupancies of the goals still feasible, which is sound for each of them,
+    and a goal is dropped as soon as a disc is placed outside its occupancy.
+
+    @param n_masks              number of distinct occupancies
+    @param masks                occupancy of each goal group
+    @param mask_goals           goals of each occupancy
+    @param n_goals              number of goals
+    @param goal_ids             index of each goal shown in the output
+    @param goal_black           black discs of each goal
+    @param goal_players         side to move of each goal
+    @param black_at             goals where the cell is black
+    @param white_at             goals where the cell is white
+    @param frozen_at            goals where the cell is frozen
+    @param outside_at           goals where the cell must stay empty
+    @param frozen_any           cells frozen in at least one goal
+    @param edge_reachability    edge tables of each goal
+    @param leaves               goals indexed by (side to move, leaf position)
+    @param n_solutions          solutions of each goal
+*/
+struct Multi_goal{
+    int n_masks;
+    uint64_t masks[MULTI_GOAL_MAX];
+    uint64_t mask_goals[MULTI_GOAL_MAX];
+    int n_goals;
+    int goal_ids[MULTI_GOAL_MAX];
+    uint64_t goal_black[MULTI_GOAL_MAX];
+    int goal_players[MULTI_GOAL_MAX];
+    uint64_t black_at[HW2];
+    uint64_t white_at[HW2];
+    uint64_t frozen_at[HW2];
+    uint64_t outside_at[HW2];
+    uint64_t frozen_any;
+    std::vector<Edge_reachability> edge_reachability;
+    std::unordered_map<Compact_state, uint64_t, Compact_state_hash> leaves[2];
+    uint64_t n_solutions[MULTI_GOAL_MAX];
+
+    /*
+        @brief set goals
+
+        @param goals                goals (player is the side to move)
+        @param players              side to move of each goal
+        @param ids                  index of each goal shown in the output
+        @param n                    number of goals (up to MULTI_GOAL_MAX)
+    */
+    void init(const Board goals[], const int players[], const int ids[], int n){
+        n_goals = n;
+        n_masks = 0;
+        edge_reachability.resize(n);
+        frozen_any = 0ULL;
+        for (int cell = 0; cell < HW2; ++cell){
+            black_at[cell] = 0ULL;
+            white_at[cell] = 0ULL;
+            frozen_at[cell] = 0ULL;
+            outside_at[cell] = 0ULL;
+        }
+        leaves[BLACK].clear();
+        leaves[WHITE].clear();
+        for (int i = 0; i < n; ++i){
+            uint64_t goal_mask = goals[i].player | goals[i].opponent;
+            uint64_t black = players[i] == BLACK ? goals[i].player : goals[i].opponent;
+            uint64_t white = goal_mask ^ black;
+            int k = (int)(std::find(masks, masks + n_masks, goal_mask) - masks);
+            if (k == n_masks){
+                masks[n_masks] = goal_mask;
+                mask_goals[n_masks++] = 0ULL;
+            }
+            mask_goals[k] |= 1ULL << i;
+            goal_black[i] = black;
+            goal_players[i] = players[i];
+            goal_ids[i] = ids[i];
+            n_solutions[i] = 0;
+            Frozen_analysis frozen_analysis;
+            frozen_analysis.init(black, white);
+            frozen_any |= frozen_analysis.frozen;
+            edge_reachability[i].init(black, white);
+            for (int cell = 0; cell < HW2; ++cell){
+                black_at[cell] |= (uint64_t)(1 & (black >> cell)) << i;
+                white_at[cell] |= (uint64_t)(1 & (white >> cell)) << i;
+                frozen_at[cell] |= (uint64_t)(1 & (frozen_analysis.frozen >> cell)) << i;
+                outside_at[cell] |= (uint64_t)(1 & (~goal_mask >> cell)) << i;
+            }
+            leaves[players[i]][Compact_state{black, white}] |= 1ULL << i;
+        }
+    }
+
+    /*
+        @brief cells that can be occupied by some goal
+
+        @param feasible             goals not refuted yet
+        @return union of the occupancies of the goals
+    */
+    inline uint64_t feasible_mask(uint64_t feasible) const{
+        uint64_t res = 0ULL;
+        for (int k = 0; k < n_masks; ++k){
+            if (mask_goals[k] & feasible)
+                res |= masks[k];
+        }
+        return res;
+    }
+
+    /*
+        @brief goals for all i in 0 ... n_goals - 1
+
+        @return bitset of all goals
+    */
+    inline uint64_t all_goals() const{
+        return n_goals == MULTI_GOAL_MAX ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << n_goals) - 1;
+    }
+};
+
+void output_transcript_multi(int goal_idx, std::vector<int> &transcript){
+    std::cout << goal_idx << " ";
+    output_transcript(transcript);
+}
+
+/*
+    @brief search all goals at once
+
+    @param board                board to search
+    @param path                 moves so far
+    @param player               side to move (BLACK / WHITE)
+    @param multi_goal           goals
+    @param feasible             goals not refuted yet
+    @param n_nodes              number of visited nodes
+*/
+void find_path_multi(Board *board, std::vector<int> &path, int player, Multi_goal *multi_goal, uint64_t feasible, uint64_t *n_nodes){
+    ++(*n_nodes);
+    uint64_t discs = board->player | board->opponent;
+    uint64_t black = player == BLACK ? board->player : board->opponent;
+    uint64_t white = discs ^ black;
+    for (int k = 0; k < multi_goal->n_masks; ++k){
+        // goals filled by this position are matched here and dropped from the subtree
+        if (discs == multi_goal->masks[k] && (multi_goal->mask_goals[k] & feasible)){
+            const auto elem = multi_goal->leaves[player].find(Compact_state{black, white});
+            if (elem != multi_goal->leaves[player].end()){
+                uint64_t matched = elem->second & feasible;
+                for (uint_fast8_t i = first_bit(&matched); matched; i = next_bit(&matched)){
+                    output_transcript_multi(multi_goal->goal_ids[i], path);
+                    ++multi_goal->n_solutions[i];
+                }
+            }
+            feasible &= ~multi_goal->mask_goals[k];
+            if (feasible == 0ULL)
+                return;
+        }
+    }
+    uint64_t goal_mask = multi_goal->feasible_mask(feasible);
+    uint64_t stable = enhanced_stability(board, goal_mask);
+    uint64_t stable_black = stable & black;
+    uint64_t stable_white = stable & white;
+    for (uint_fast8_t cell = first_bit(&stable_black); stable_black; cell = next_bit(&stable_black))
+        feasible &= ~multi_goal->white_at[cell];
+    for (uint_fast8_t cell = first_bit(&stable_white); stable_white; cell = next_bit(&stable_white))
+        feasible &= ~multi_goal->black_at[cell];
+    if (feasible == 0ULL)
+        return;
+    if (multi_goal->n_masks > 1)
+        goal_mask = multi_goal->feasible_mask(feasible);
+    __m256i chain_l, chain_r;
+    uint64_t legal = calc_legal_chain(board->player, board->opponent, &chain_l, &chain_r) & goal_mask;
+    if (legal){
+        const uint64_t *wrong_color_at = player == BLACK ? multi_goal->white_at : multi_goal->black_at;
+        Flip flips[HW2];
+        int n_moves = calc_flip_all(legal, chain_l, chain_r, flips);
+        for (int j = 0; j < n_moves; ++j){
+            const Flip &flip = flips[j];
+            const uint_fast8_t cell = flip.pos;
+            uint64_t child_feasible = feasible & ~((multi_goal->frozen_at[cell] & wrong_color_at[cell]) | multi_goal->outside_at[cell]);
+            if (child_feasible == 0ULL)
+                continue;
+            uint64_t flipped_frozen = flip.flip & multi_goal->frozen_any;
+            for (uint_fast8_t f = first_bit(&flipped_frozen); flipped_frozen; f = next_bit(&flipped_frozen))
+                child_feasible &= ~multi_goal->frozen_at[f];
+            if (child_feasible == 0ULL)
+                continue;
+            board->move_board(&flip);
+            // edge lines change only with a move on the edge
+            if ((1ULL << cell) & EDGE_CELLS){
+                uint64_t n_black = player == BLACK ? board->opponent : board->player;
+                uint64_t n_white = (board->player | board->opponent) ^ n_black;
+                uint64_t goals = child_feasible;
+                for (uint_fast8_t i = first_bit(&goals); goals; i = next_bit(&goals)){
+                    if (!multi_goal->edge_reachability[i].check(n_black, n_white))
+                        child_feasible &= ~(1ULL << i);
+                }
+                if (child_feasible == 0ULL){
+                    board->undo_board(&flip);
+                    continue;
+                }
+            }
+            path.emplace_back(cell);
+                find_path_multi(board, path, player ^ 1, multi_goal, child_feasible, n_nodes);
+            path.pop_back();
+            board->undo_board(&flip);
+        }
+    }
+}
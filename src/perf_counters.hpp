@@ -0,0 +1,281 @@
+/*
+    Reverse Othello
+
+    @file perf_counters.hpp
+        Hardware performance counters of a search (Linux perf_event_open)
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+// number of events counted at most
+#define PERF_COUNTERS_MAX_EVENTS 5
+
+// phases of a node
+#define PERF_PHASE_MOVE_GENERATION 0
+#define PERF_PHASE_FLIP 1
+#define PERF_PHASE_STABILITY 2
+#define PERF_PHASE_OUTPUT 3
+#define PERF_N_PHASES 4
+
+// one node in this many is measured by phase, as reading the counters perturbs the search
+#define PERF_COUNTERS_SAMPLE_EVERY 64
+
+const std::string perf_phase_str[PERF_N_PHASES] = {"move generation", "flip", "stability", "output"};
+
+/*
+    @brief Hardware performance counters
+
+    The whole search is counted with read(). Phases are counted on sampled nodes with
+    rdpmc when the kernel allows it, otherwise with the time stamp counter only.
+    Without counters (no PMU, perf_event_paranoid, other OS) only the phases are shown.
+
+    @param n_events             number of events opened
+    @param names                name of each event
+    @param fds                  file descriptor of each event (fds[0] is the group leader)
+    @param pages                mapped page of each event for rdpmc
+    @param use_rdpmc            phases are counted with rdpmc
+    @param totals               counts of the whole search
+    @param start_values         counts at the start of the search
+    @param begin_values         counts at the beginning of the current phase
+    @param phase_values         counts of each phase
+    @param phase_calls          measured calls of each phase
+*/
+class Perf_counters{
+    public:
+        int n_events;
+        std::string names[PERF_COUNTERS_MAX_EVENTS];
+        uint64_t totals[PERF_COUNTERS_MAX_EVENTS];
+        uint64_t phase_values[PERF_N_PHASES][PERF_COUNTERS_MAX_EVENTS];
+        uint64_t phase_calls[PERF_N_PHASES];
+
+    private:
+        int fds[PERF_COUNTERS_MAX_EVENTS];
+    #ifdef __linux__
+        perf_event_mmap_page *pages[PERF_COUNTERS_MAX_EVENTS];
+    #endif
+        bool use_rdpmc;
+        uint64_t start_values[PERF_COUNTERS_MAX_EVENTS];
+        uint64_t begin_values[PERF_COUNTERS_MAX_EVENTS];
+
+    public:
+        Perf_counters(){
+            n_events = 0;
+            use_rdpmc = false;
+            for (int i = 0; i < PERF_N_PHASES; ++i){
+                phase_calls[i] = 0;
+                for (int j = 0; j < PERF_COUNTERS_MAX_EVENTS; ++j)
+                    phase_values[i][j] = 0;
+            }
+        }
+
+        ~Perf_counters(){
+            close();
+        }
+
+        Perf_counters(const Perf_counters&) = delete;
+        Perf_counters &operator=(const Perf_counters&) = delete;
+
+        /*
+            @brief open the counters
+
+            Events the CPU or the kernel refuses are left out.
+
+            @return some hardware counter opened?
+        */
+        bool open(){
+            close();
+        #ifdef __linux__
+            const uint32_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            const struct{
+                uint32_t type;
+                uint64_t config;
+                const char *name;
+            } events[PERF_COUNTERS_MAX_EVENTS] = {
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch-misses"},
+                {PERF_TYPE_HW_CACHE, l1d_read_miss, "L1d-misses"},
+                {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses"}
+            };
+            use_rdpmc = true;
+            for (int i = 0; i < PERF_COUNTERS_MAX_EVENTS; ++i){
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = events[i].type;
+                attr.config = events[i].config;
+                attr.disabled = n_events == 0;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, n_events ? fds[0] : -1, 0);
+                if (fd < 0){
+                    // without cycles as the leader, nothing else is counted
+                    if (n_events == 0)
+                        break;
+                    continue;
+                }
+                void *page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+                pages[n_events] = page == MAP_FAILED ? nullptr : (perf_event_mmap_page*)page;
+                use_rdpmc &= pages[n_events] != nullptr && pages[n_events]->cap_user_rdpmc;
+                fds[n_events] = fd;
+                names[n_events] = events[i].name;
+                ++n_events;
+            }
+            if (n_events){
+                ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+                ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+            }
+        #endif
+            if (n_events == 0){
+                use_rdpmc = false;
+                names[0] = "tsc-ticks";
+            }
+            return n_events > 0;
+        }
+
+        /*
+            @brief close the counters
+        */
+        void close(){
+        #ifdef __linux__
+            for (int i = 0; i < n_events; ++i){
+                if (pages[i] != nullptr)
+                    munmap(pages[i], sysconf(_SC_PAGESIZE));
+                ::close(fds[i]);
+            }
+        #endif
+            n_events = 0;
+        }
+
+        /*
+            @brief start counting the whole search
+        */
+        void start(){
+            read_all(start_values);
+        }
+
+        /*
+            @brief stop counting the whole search
+        */
+        void stop(){
+            read_all(totals);
+            for (int i = 0; i < n_events; ++i)
+                totals[i] -= start_values[i];
+        }
+
+        /*
+            @brief begin a phase
+        */
+        inline void begin(){
+            read_fast(begin_values);
+        }
+
+        /*
+            @brief end a phase
+
+            @param phase                PERF_PHASE_*
+        */
+        inline void end(int phase){
+            uint64_t values[PERF_COUNTERS_MAX_EVENTS];
+            read_fast(values);
+            for (int i = 0; i < n_phase_events(); ++i)
+                phase_values[phase][i] += values[i] - begin_values[i];
+            ++phase_calls[phase];
+        }
+
+        /*
+            @brief print the results
+
+            @param n_nodes              number of visited nodes
+        */
+        void print(uint64_t n_nodes) const{
+            n_nodes = std::max<uint64_t>(n_nodes, 1);
+            if (n_events == 0)
+                std::cerr << "perf counters not available, phases in time stamp counter ticks" << std::endl;
+            else{
+                std::cerr << "perf";
+                for (int i = 0; i < n_events; ++i)
+                    std::cerr << " " << names[i] << " " << totals[i] << " (" << (double)totals[i] / n_nodes << "/node)";
+                if (n_events >= 2 && names[1] == "instructions" && totals[0])
+                    std::cerr << " IPC " << (double)totals[1] / totals[0];
+                std::cerr << std::endl;
+                if (!use_rdpmc)
+                    std::cerr << "rdpmc not available, phases in time stamp counter ticks" << std::endl;
+            }
+            for (int p = 0; p < PERF_N_PHASES; ++p){
+                if (phase_calls[p] == 0)
+                    continue;
+                std::cerr << "perf phase " << perf_phase_str[p] << " " << phase_calls[p] << " sampled calls";
+                for (int i = 0; i < n_phase_events(); ++i)
+                    std::cerr << " " << (use_rdpmc ? names[i] : std::string("tsc-ticks")) << " " << (double)phase_values[p][i] / phase_calls[p] << "/call";
+                std::cerr << std::endl;
+            }
+        }
+
+    private:
+        inline int n_phase_events() const{
+            return use_rdpmc ? n_events : 1;
+        }
+
+        void read_all(uint64_t values[]){
+        #ifdef __linux__
+            for (int i = 0; i < n_events; ++i){
+                if (::read(fds[i], &values[i], sizeof(uint64_t)) != sizeof(uint64_t))
+                    values[i] = 0;
+            }
+        #endif
+        }
+
+        inline void read_fast(uint64_t values[]){
+        #ifdef __linux__
+            if (use_rdpmc){
+                for (int i = 0; i < n_events; ++i)
+                    values[i] = read_rdpmc(pages[i]);
+                return;
+            }
+        #endif
+            values[0] = __rdtsc();
+        }
+
+    #ifdef __linux__
+        /*
+            @brief read a counter from user space (see perf_event_open(2))
+        */
+        static inline uint64_t read_rdpmc(const perf_event_mmap_page *page){
+            uint32_t seq;
+            uint64_t count;
+            do{
+                seq = page->lock;
+                __asm__ __volatile__("" ::: "memory");
+                uint32_t idx = page->index;
+                count = page->offset;
+                if (page->cap_user_rdpmc && idx){
+                    int shift = 64 - page->pmc_width;
+                    count += (uint64_t)(((int64_t)__rdpmc(idx - 1) << shift) >> shift);
+                }
+                __asm__ __volatile__("" ::: "memory");
+            } while (page->lock != seq);
+            return count;
+        }
+    #endif
+};
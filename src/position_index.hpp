@@ -0,0 +1,342 @@
+/*
+    Reverse Othello
+
+    @file position_index.hpp
+        On-disk index from positions to archived games
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <queue>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#include "search.hpp"
+#include "transcript.hpp"
+#include "mapped_file.hpp"
+
+#define POSITION_INDEX_MAGIC "ROPIDX1"
+
+// entries sorted in memory at once while building
+#define POSITION_INDEX_RUN_ENTRIES (1 << 24)
+
+// entries read at once from each run while merging
+#define POSITION_INDEX_MERGE_BUFFER (1 << 16)
+
+/*
+    @brief Index file header
+
+    followed by n_entries Position_index_entry sorted by (key, game, ply)
+
+    @param magic                POSITION_INDEX_MAGIC
+    @param n_games              number of games indexed
+    @param n_entries            number of entries
+*/
+struct Position_index_header{
+    char magic[8];
+    uint64_t n_games;
+    uint64_t n_entries;
+};
+
+/*
+    @brief Index entry
+
+    @param key                  position_index_key of the position
+    @param game                 game id (line number in the archive)
+    @param ply                  number of moves played to reach the position
+*/
+struct Position_index_entry{
+    uint64_t key;
+    uint32_t game;
+    uint32_t ply;
+
+    bool operator<(const Position_index_entry &another) const{
+        if (key != another.key)
+            return key < another.key;
+        if (game != another.game)
+            return game < another.game;
+        return ply < another.ply;
+    }
+
+    bool operator>(const Position_index_entry &another) const{
+        return another < *this;
+    }
+};
+
+/*
+    @brief key of a position, the same for its 8 symmetric positions
+
+    @param black                black discs
+    @param white                white discs
+    @param player               side to move
+    @return 64-bit key
+*/
+inline uint64_t position_index_key(uint64_t black, uint64_t white, int player){
+    Board board = {black, white};
+    Board best = board;
+    for (int i = 0; i < 8; ++i){
+        // 4 rotations, then the same on the mirrored board
+        if (i == 4)
+            board.board_black_line_mirror();
+        else if (i)
+            board.board_rotate_90();
+        if (board.player < best.player || (board.player == best.player && board.opponent < best.opponent))
+            best = board;
+    }
+    return hash_compact_state(Compact_state{best.player, hash_compact_state(Compact_state{best.opponent, (uint64_t)player})});
+}
+
+/*
+    @brief replay an archived game with passes and add its positions
+
+    @param transcript           transcript (passes are not written)
+    @param game                 game id
+    @param entries              vector to append entries to
+    @return valid?
+*/
+bool position_index_add_game(const std::string &transcript, uint32_t game, std::vector<Position_index_entry> &entries){
+    Board board = {INITIAL_BLACK, INITIAL_WHITE};
+    int player = BLACK;
+    Flip flip;
+    size_t n_before = entries.size();
+    for (int i = 0; i + 1 < (int)transcript.length(); i += 2){
+        int cell = coord_to_idx(transcript[i], transcript[i + 1]);
+        uint64_t legal = board.get_legal();
+        if (legal == 0ULL){
+            board.pass();
+            player ^= 1;
+            legal = board.get_legal();
+        }
+        if (cell < 0 || (1 & (legal >> cell)) == 0){
+            entries.resize(n_before);
+            return false;
+        }
+        calc_flip(&flip, &board, cell);
+        board.move_board(&flip);
+        player ^= 1;
+        uint64_t black = player == BLACK ? board.player : board.opponent;
+        uint64_t white = player == BLACK ? board.opponent : board.player;
+        entries.emplace_back(Position_index_entry{position_index_key(black, white, player), game, (uint32_t)(i / 2 + 1)});
+    }
+    if (transcript.length() % 2){
+        entries.resize(n_before);
+        return false;
+    }
+    return true;
+}
+
+/*
+    @brief Index builder
+
+    Entries are sorted in runs of POSITION_INDEX_RUN_ENTRIES,
+    and the runs are merged into the index file at the end.
+
+    @param path                 index file
+    @param entries              entries of the current run
+    @param runs                 run files written
+    @param n_games              number of games added
+    @param n_entries            number of entries added
+*/
+class Position_index_builder{
+    public:
+        std::string path;
+        std::vector<Position_index_entry> entries;
+        std::vector<std::string> runs;
+        uint64_t n_games;
+        uint64_t n_entries;
+
+    public:
+        void init(const std::string &p){
+            path = p;
+            entries.clear();
+            runs.clear();
+            n_games = 0;
+            n_entries = 0;
+        }
+
+        /*
+            @brief add a game
+
+            @param transcript           transcript
+            @param game                 game id
+            @return valid?
+        */
+        bool add(const std::string &transcript, uint32_t game){
+            size_t n_before = entries.size();
+            if (!position_index_add_game(transcript, game, entries))
+                return false;
+            ++n_games;
+            n_entries += entries.size() - n_before;
+            if (entries.size() >= POSITION_INDEX_RUN_ENTRIES)
+                return flush_run();
+            return true;
+        }
+
+        /*
+            @brief write the index file
+
+            @return written?
+        */
+        bool finish(){
+            FILE *out = fopen(path.c_str(), "wb");
+            if (out == nullptr){
+                std::cerr << "[ERROR] can't open " << path << std::endl;
+                return false;
+            }
+            Position_index_header header;
+            memset(&header, 0, sizeof(header));
+            strncpy(header.magic, POSITION_INDEX_MAGIC, sizeof(header.magic));
+            header.n_games = n_games;
+            header.n_entries = n_entries;
+            fwrite(&header, sizeof(header), 1, out);
+            bool res = true;
+            if (runs.empty()){
+                std::sort(entries.begin(), entries.end());
+                res = fwrite(entries.data(), sizeof(Position_index_entry), entries.size(), out) == entries.size();
+            } else{
+                if (!entries.empty())
+                    res = flush_run();
+                res = res && merge_runs(out);
+            }
+            res = (fclose(out) == 0) && res;
+            if (!res)
+                std::cerr << "[ERROR] can't write " << path << std::endl;
+            return res;
+        }
+
+    private:
+        bool flush_run(){
+            std::sort(entries.begin(), entries.end());
+            std::string run_path = path + ".run" + std::to_string(runs.size());
+            FILE *run = fopen(run_path.c_str(), "wb");
+            if (run == nullptr){
+                std::cerr << "[ERROR] can't open " << run_path << std::endl;
+                return false;
+            }
+            bool res = fwrite(entries.data(), sizeof(Position_index_entry), entries.size(), run) == entries.size();
+            res = (fclose(run) == 0) && res;
+            runs.emplace_back(run_path);
+            entries.clear();
+            return res;
+        }
+
+        bool merge_runs(FILE *out){
+            struct Run_reader{
+                FILE *file;
+                std::vector<Position_index_entry> buffer;
+                size_t pos;
+
+                bool next(Position_index_entry *entry){
+                    if (pos == buffer.size()){
+                        buffer.resize(POSITION_INDEX_MERGE_BUFFER);
+                        buffer.resize(fread(buffer.data(), sizeof(Position_index_entry), POSITION_INDEX_MERGE_BUFFER, file));
+                        pos = 0;
+                        if (buffer.empty())
+                            return false;
+                    }
+                    *entry = buffer[pos++];
+                    return true;
+                }
+            };
+            std::vector<Run_reader> readers(runs.size());
+            typedef std::pair<Position_index_entry, int> Head;
+            std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+            bool res = true;
+            for (int i = 0; i < (int)runs.size(); ++i){
+                readers[i].file = fopen(runs[i].c_str(), "rb");
+                readers[i].pos = 0;
+                Position_index_entry entry;
+                if (readers[i].file == nullptr)
+                    res = false;
+                else if (readers[i].next(&entry))
+                    heads.emplace(entry, i);
+            }
+            std::vector<Position_index_entry> out_buffer;
+            out_buffer.reserve(POSITION_INDEX_MERGE_BUFFER);
+            while (res && !heads.empty()){
+                Head head = heads.top();
+                heads.pop();
+                out_buffer.emplace_back(head.first);
+                if (out_buffer.size() == POSITION_INDEX_MERGE_BUFFER){
+                    res = fwrite(out_buffer.data(), sizeof(Position_index_entry), out_buffer.size(), out) == out_buffer.size();
+                    out_buffer.clear();
+                }
+                Position_index_entry entry;
+                if (readers[head.second].next(&entry))
+                    heads.emplace(entry, head.second);
+            }
+            if (res)
+                res = fwrite(out_buffer.data(), sizeof(Position_index_entry), out_buffer.size(), out) == out_buffer.size();
+            for (int i = 0; i < (int)runs.size(); ++i){
+                if (readers[i].file != nullptr)
+                    fclose(readers[i].file);
+                remove(runs[i].c_str());
+            }
+            runs.clear();
+            return res;
+        }
+};
+
+/*
+    @brief Memory-mapped index
+
+    @param file                 mapped index file
+    @param header               header
+    @param entries              sorted entries
+*/
+class Position_index{
+    public:
+        Mapped_file file;
+        const Position_index_header *header;
+        const Position_index_entry *entries;
+
+    public:
+        /*
+            @brief open an index file
+
+            @param path                 index file
+            @return opened?
+        */
+        bool open(const std::string &path){
+            if (!file.open(path) || file.size < sizeof(Position_index_header)){
+                std::cerr << "[ERROR] can't open " << path << std::endl;
+                return false;
+            }
+            header = (const Position_index_header*)file.data;
+            entries = (const Position_index_entry*)(file.data + sizeof(Position_index_header));
+            if (strncmp(header->magic, POSITION_INDEX_MAGIC, sizeof(header->magic)) != 0 || file.size != sizeof(Position_index_header) + header->n_entries * sizeof(Position_index_entry)){
+                std::cerr << "[ERROR] invalid index " << path << std::endl;
+                file.close();
+                return false;
+            }
+            return true;
+        }
+
+        /*
+            @brief games that reach a position (or one of its symmetric positions)
+
+            @param black                black discs
+            @param white                white discs
+            @param player               side to move
+            @param n                    number of entries found
+            @return first entry found
+        */
+        const Position_index_entry *find(uint64_t black, uint64_t white, int player, uint64_t *n) const{
+            uint64_t key = position_index_key(black, white, player);
+            const Position_index_entry *end = entries + header->n_entries;
+            const Position_index_entry *first = std::lower_bound(entries, end, key, [](const Position_index_entry &entry, uint64_t k){
+                return entry.key < k;
+            });
+            const Position_index_entry *last = first;
+            while (last != end && last->key == key)
+                ++last;
+            *n = last - first;
+            return first;
+        }
+};
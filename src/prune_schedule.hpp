@@ -0,0 +1,191 @@
+/*
+    Reverse Othello
+
+    @file prune_schedule.hpp
+        Per-ply schedule of the stability cut from measured cost and yield
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <algorithm>
+#ifdef _MSC_VER
+    #include <intrin.h>
+#else
+    #include <x86intrin.h>
+#endif
+#include "engine/board.hpp"
+
+// stability cuts measured before the schedule is chosen
+#define PRUNE_SCHEDULE_SAMPLE_CALLS (1 << 18)
+
+// one stability cut in this many is timed, reading the clock costs about as much as the cut
+#define PRUNE_SCHEDULE_TIME_EVERY 16
+
+// timed stability cuts longer than this were interrupted and are not counted
+#define PRUNE_SCHEDULE_MAX_TICKS 4096
+
+// plies with fewer samples keep the stability cut
+#define PRUNE_SCHEDULE_MIN_CALLS 1024
+
+// the decision changes from the previous ply only if it is this many times cheaper
+#define PRUNE_SCHEDULE_MARGIN 8.0
+
+/*
+    @brief Sampler and schedule of the stability cut
+
+    While sampling, the result of every stability cut (and the time of some of them)
+    is recorded by the number of moves left (0: the last move before the goal). Then the plies are decided from
+    the last one up. A position cut by stability stays cut in all its descendants,
+    because stable discs never change, so skipping the cut at a ply costs the children
+    of the positions it would have cut, each handled as decided for the next ply.
+    The decision of the previous ply is kept unless the other one is clearly cheaper,
+    so the cut is turned off only for a run of plies where it costs much more than it
+    saves, instead of flipping on and off with the noise of the timing.
+
+    @param n_calls              stability cuts run
+    @param n_cuts               positions cut
+    @param n_timed              stability cuts timed
+    @param ticks                time stamp counter ticks spent in the timed cuts
+    @param n_calls_all          stability cuts run at all plies
+    @param start_ticks          time stamp counter at the start
+    @param start_nodes          visited nodes at the start
+    @param tick_overhead        ticks of reading the time stamp counter twice
+    @param use_stability        the schedule, stability cut is run if true
+*/
+struct Prune_schedule{
+    uint64_t n_calls[HW2];
+    uint64_t n_cuts[HW2];
+    uint64_t n_timed[HW2];
+    uint64_t ticks[HW2];
+    uint64_t n_calls_all;
+    uint64_t start_ticks;
+    uint64_t start_nodes;
+    uint64_t tick_overhead;
+    bool use_stability[HW2];
+
+    /*
+        @brief start sampling
+
+        @param n_nodes              visited nodes so far
+    */
+    void init(uint64_t n_nodes){
+        for (int i = 0; i < HW2; ++i){
+            n_calls[i] = 0;
+            n_cuts[i] = 0;
+            n_timed[i] = 0;
+            ticks[i] = 0;
+            use_stability[i] = true;
+        }
+        n_calls_all = 0;
+        tick_overhead = 0xFFFFFFFFFFFFFFFFULL;
+        for (int i = 0; i < 64; ++i){
+            uint64_t t = __rdtsc();
+            tick_overhead = std::min<uint64_t>(tick_overhead, __rdtsc() - t);
+        }
+        start_nodes = n_nodes;
+        start_ticks = __rdtsc();
+    }
+
+    /*
+        @brief the next stability cut should be timed
+
+        @return time it?
+    */
+    inline bool timed() const{
+        return n_calls_all % PRUNE_SCHEDULE_TIME_EVERY == 0;
+    }
+
+    /*
+        @brief record the time of a stability cut
+
+        @param n_left               moves left before the move that fills goal_mask
+        @param t                    ticks spent
+    */
+    inline void add_ticks(int n_left, uint64_t t){
+        if (t > PRUNE_SCHEDULE_MAX_TICKS)
+            return;
+        ++n_timed[n_left];
+        ticks[n_left] += t > tick_overhead ? t - tick_overhead : 0;
+    }
+
+    /*
+        @brief record a stability cut
+
+        @param n_left               moves left before the move that fills goal_mask
+        @param cut                  the position was cut
+        @return enough samples?
+    */
+    inline bool add(int n_left, bool cut){
+        ++n_calls[n_left];
+        n_cuts[n_left] += cut;
+        return ++n_calls_all >= PRUNE_SCHEDULE_SAMPLE_CALLS;
+    }
+
+    /*
+        @brief average ticks of a stability cut
+
+        @param n_left               moves left before the move that fills goal_mask
+        @return ticks
+    */
+    inline double stability_ticks(int n_left) const{
+        return n_timed[n_left] ? (double)ticks[n_left] / n_timed[n_left] : 0.0;
+    }
+
+    /*
+        @brief choose the schedule from the samples
+
+        @param n_nodes              visited nodes so far
+    */
+    void decide(uint64_t n_nodes){
+        uint64_t total_ticks = __rdtsc() - start_ticks;
+        double all_stability_ticks = 0.0;
+        uint64_t n_inner = 0;
+        for (int i = 0; i < HW2; ++i){
+            all_stability_ticks += stability_ticks(i) * n_calls[i];
+            n_inner += n_calls[i];
+        }
+        uint64_t n_sampled = std::max<uint64_t>(n_nodes - start_nodes, 1);
+        // cost of a node without the stability cut
+        double t_node = std::max(0.0, (double)total_ticks - all_stability_ticks) / n_sampled;
+        // the children of the last move are only compared with the goal
+        uint64_t n_leaves = n_sampled > n_inner ? n_sampled - n_inner : 0;
+        // cost of a position that can't reach the goal, at the previous ply
+        double dead_cost = t_node;
+        for (int i = 0; i < HW2; ++i){
+            uint64_t n_children = i == 0 ? n_leaves : n_calls[i - 1];
+            uint64_t n_expanded = n_calls[i] - n_cuts[i];
+            if (n_calls[i] < PRUNE_SCHEDULE_MIN_CALLS || n_expanded == 0){
+                use_stability[i] = true;
+                dead_cost = t_node + stability_ticks(i);
+                continue;
+            }
+            double t_stability = stability_ticks(i);
+            double cut_rate = (double)n_cuts[i] / n_calls[i];
+            double branching = (double)n_children / n_expanded;
+            double saved = cut_rate * branching * dead_cost;
+            bool prev_stability = i == 0 || use_stability[i - 1];
+            use_stability[i] = prev_stability ? t_stability < PRUNE_SCHEDULE_MARGIN * saved : saved > PRUNE_SCHEDULE_MARGIN * t_stability;
+            dead_cost = t_node + (use_stability[i] ? t_stability : branching * dead_cost);
+        }
+    }
+
+    /*
+        @brief describe the schedule
+
+        @return plies sampled with their cut rate and decision
+    */
+    std::string str() const{
+        std::string res = "stability schedule (moves left: cut rate, ticks, on/off):";
+        for (int i = 0; i < HW2; ++i){
+            if (n_calls[i] < PRUNE_SCHEDULE_MIN_CALLS)
+                continue;
+            res += " " + std::to_string(i) + ": " + std::to_string(100 * n_cuts[i] / n_calls[i]) + "% " + std::to_string((uint64_t)stability_ticks(i)) + (use_stability[i] ? " on" : " off") + ",";
+        }
+        if (res.back() == ',')
+            res.pop_back();
+        return res;
+    }
+};
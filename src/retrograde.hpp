@@ -0,0 +1,314 @@
+/*
+    Reverse Othello
+
+    @file retrograde.hpp
+        Backward search from the goal to the initial position
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <vector>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#include "estimate.hpp"
+
+// d4, d5, e4 and e5 are never removed
+#define CENTER_CELLS 0x0000001818000000ULL
+
+// upper bound of positions memorized as dead
+#define RETROGRADE_DEAD_MAX (1 << 22)
+
+/*
+    @brief Unmove structure
+
+    @param pos                  cell of the disc placed by the last move
+    @param flip                 discs flipped by the last move
+*/
+struct Unmove{
+    uint_fast8_t pos;
+    uint64_t flip;
+};
+
+constexpr int unmove_dy[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+constexpr int unmove_dx[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+
+/*
+    @brief enumerate moves that lead to the board
+
+    The last move was made by board->opponent.
+    Along each direction the move flipped a prefix of the mover's run next to it,
+    and the disc after the prefix is the outflanking disc.
+    A direction without flips must not have been flippable before the move.
+
+    @param board                board after the move
+    @param fixed                discs of the start position, never removed
+    @param unmoves              vector to store result
+*/
+inline void calc_unmoves(const Board *board, const uint64_t fixed, std::vector<Unmove> &unmoves){
+    unmoves.clear();
+    const uint64_t mover = board->opponent;
+    const uint64_t other = board->player;
+    uint64_t candidates = mover & ~fixed;
+    uint64_t options[8][HW];
+    int n_options[8];
+    for (uint_fast8_t cell = first_bit(&candidates); candidates; cell = next_bit(&candidates)){
+        bool possible = true;
+        for (int dir = 0; dir < 8 && possible; ++dir){
+            uint64_t line[HW];
+            int n_line = 0;
+            int y = cell / HW + unmove_dy[dir], x = cell % HW + unmove_dx[dir];
+            for (; 0 <= y && y < HW && 0 <= x && x < HW; y += unmove_dy[dir], x += unmove_dx[dir])
+                line[n_line++] = 1ULL << (y * HW + x);
+            int n_mover = 0;
+            while (n_mover < n_line && (mover & line[n_mover]))
+                ++n_mover;
+            int n_other = 0;
+            while (n_other < n_line && (other & line[n_other]))
+                ++n_other;
+            n_options[dir] = 0;
+            // no flip: the line must not have been outflanked before the move
+            if (n_other == 0 || n_other == n_line || (mover & line[n_other]) == 0)
+                options[dir][n_options[dir]++] = 0ULL;
+            uint64_t f = 0ULL;
+            for (int k = 0; k + 1 < n_mover; ++k){
+                f |= line[k];
+                options[dir][n_options[dir]++] = f;
+            }
+            possible = n_options[dir] > 0;
+        }
+        if (!possible)
+            continue;
+        int idx[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        while (true){
+            uint64_t f = 0ULL;
+            for (int dir = 0; dir < 8; ++dir)
+                f |= options[dir][idx[dir]];
+            if (f)
+                unmoves.push_back(Unmove{cell, f});
+            int dir = 0;
+            while (dir < 8 && ++idx[dir] == n_options[dir]){
+                idx[dir] = 0;
+                ++dir;
+            }
+            if (dir == 8)
+                break;
+        }
+    }
+}
+
+/*
+    @brief undo a move
+
+    @param board                board after the move (player is the side to move)
+    @param unmove               move to undo
+    @param res                  board before the move (player is the mover)
+*/
+inline void unmove_board(const Board *board, const Unmove *unmove, Board *res){
+    res->player = board->opponent ^ unmove->flip ^ (1ULL << unmove->pos);
+    res->opponent = board->player ^ unmove->flip;
+}
+
+/*
+    @brief every disc is connected to the center
+
+    Each move is placed next to a flipped disc, so discs of a reachable position are 8-connected.
+
+    @param discs                discs
+    @return connected?
+*/
+inline bool is_connected(const uint64_t discs){
+    uint64_t conn = discs & CENTER_CELLS, prev = 0ULL;
+    while (conn != prev){
+        prev = conn;
+        uint64_t h = conn | ((conn << 1) & 0xFEFEFEFEFEFEFEFEULL) | ((conn >> 1) & 0x7F7F7F7F7F7F7F7FULL);
+        conn = (h | (h << 8) | (h >> 8)) & discs;
+    }
+    return conn == discs;
+}
+
+/*
+    @brief side to move of a position without passes
+
+    @param n_discs              number of discs
+    @param start_n_discs        number of discs of the start position
+    @param start_player         side to move of the start position
+    @return BLACK / WHITE
+*/
+inline int side_to_move(int n_discs, int start_n_discs, int start_player){
+    return start_player ^ ((n_discs - start_n_discs) & 1);
+}
+
+/*
+    @brief Backward search context
+
+    @param encoder              encoder for dead positions
+    @param dead                 positions from which the start position is unreachable
+    @param unmoves              unmove buffer of each depth
+    @param start                start position (player is the side to move)
+    @param start_player         side to move of the start position
+    @param start_n_discs        number of discs of the start position
+    @param prefix               moves that led to the start position
+    @param print                show the transcripts found (false: only count them)
+*/
+struct Retrograde_search{
+    State_encoder encoder;
+    Compact_state_set dead;
+    std::vector<Unmove> unmoves[HW2];
+    Board start;
+    int start_player;
+    int start_n_discs;
+    std::vector<int> prefix;
+    bool print;
+
+    inline void init(uint64_t goal_mask){
+        encoder.init(goal_mask);
+        dead.init(&encoder);
+        start = Board{INITIAL_BLACK, INITIAL_WHITE};
+        start_player = BLACK;
+        start_n_discs = N_INITIAL_DISCS;
+        prefix.clear();
+        print = true;
+    }
+
+    /*
+        @brief set the position the search ends at (default: the initial position)
+
+        @param s                    start board (player is the side to move)
+        @param s_player             side to move of the start board
+        @param s_prefix             moves that led to the start board
+    */
+    inline void set_start(const Board *s, int s_player, const std::vector<int> &s_prefix){
+        start = *s;
+        start_player = s_player;
+        start_n_discs = s->n_discs();
+        prefix = s_prefix;
+    }
+};
+
+/*
+    @brief output a backward path in forward order
+
+    @param prefix               moves before the start position
+    @param path                 moves from the goal backward
+*/
+void output_transcript_backward(const std::vector<int> &prefix, const std::vector<int> &path){
+    for (const int &move: prefix)
+        std::cout << idx_to_coord(move);
+    for (auto move = path.rbegin(); move != path.rend(); ++move)
+        std::cout << idx_to_coord(*move);
+    std::cout << std::endl;
+}
+
+/*
+    @brief search backward from a position to the start position
+
+    @param board                board (player is the side to move)
+    @param path                 moves undone so far
+    @param player               side to move (BLACK / WHITE)
+    @param search               backward search context
+    @param n_nodes              number of visited nodes
+    @param n_solutions          number of solutions
+*/
+void find_path_backward(const Board *board, std::vector<int> &path, int player, Retrograde_search *search, uint64_t *n_nodes, uint64_t *n_solutions){
+    ++(*n_nodes);
+    if (board->n_discs() == search->start_n_discs){
+        if (player == search->start_player && board->player == search->start.player && board->opponent == search->start.opponent){
+            if (search->print)
+                output_transcript_backward(search->prefix, path);
+            ++(*n_solutions);
+        }
+        return;
+    }
+    Board key_board = player == BLACK ? Board{board->player, board->opponent} : Board{board->opponent, board->player};
+    Compact_state key = search->encoder.encode(&key_board);
+    if (search->dead.contains(key))
+        return;
+    uint64_t n_solutions_before = *n_solutions;
+    std::vector<Unmove> &unmoves = search->unmoves[path.size()];
+    calc_unmoves(board, search->start.player | search->start.opponent, unmoves);
+    Board prev;
+    for (const Unmove &unmove: unmoves){
+        unmove_board(board, &unmove, &prev);
+        if (!is_connected(prev.player | prev.opponent))
+            continue;
+        path.emplace_back(unmove.pos);
+            find_path_backward(&prev, path, player ^ 1, search, n_nodes, n_solutions);
+        path.pop_back();
+    }
+    if (*n_solutions == n_solutions_before && search->dead.size() < RETROGRADE_DEAD_MAX)
+        search->dead.insert(key);
+}
+
+/*
+    @brief one random probe through the backward tree
+
+    @param board                goal board (player is the side to move)
+    @param player               side to move
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param est_nodes            estimated nodes
+    @param est_solutions        estimated solutions
+    @return number of nodes visited by this probe
+*/
+uint64_t estimate_probe_backward(Board board, int player, const Board *start, int start_player, double *est_nodes, double *est_solutions){
+    const uint64_t fixed = start->player | start->opponent;
+    const int start_n_discs = start->n_discs();
+    double weight = 1.0;
+    uint64_t n_probe_nodes = 0;
+    std::vector<Unmove> unmoves;
+    std::vector<Board> children;
+    *est_nodes = 0.0;
+    *est_solutions = 0.0;
+    while (true){
+        ++n_probe_nodes;
+        *est_nodes += weight;
+        if (board.n_discs() == start_n_discs){
+            if (player == start_player && board.player == start->player && board.opponent == start->opponent)
+                *est_solutions += weight;
+            break;
+        }
+        calc_unmoves(&board, fixed, unmoves);
+        children.clear();
+        Board prev;
+        for (const Unmove &unmove: unmoves){
+            unmove_board(&board, &unmove, &prev);
+            if (is_connected(prev.player | prev.opponent))
+                children.emplace_back(prev);
+        }
+        if (children.empty())
+            break;
+        weight *= children.size();
+        board = children[myrandrange(0, (int)children.size())];
+        player ^= 1;
+    }
+    return n_probe_nodes;
+}
+
+/*
+    @brief estimate the backward search within a time budget
+
+    @param goal                 goal board (player is the side to move)
+    @param goal_player          side to move of the goal
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param time_limit           time budget in ms
+    @return estimation result
+*/
+Estimate_result estimate_path_backward(const Board *goal, int goal_player, const Board *start, int start_player, uint64_t time_limit){
+    Estimate_result res;
+    uint64_t strt = tim();
+    uint64_t n_probe_nodes = 0;
+    double est_nodes, est_solutions;
+    do {
+        for (int i = 0; i < 64; ++i){
+            n_probe_nodes += estimate_probe_backward(*goal, goal_player, start, start_player, &est_nodes, &est_solutions);
+            res.nodes.add(est_nodes);
+            res.solutions.add(est_solutions);
+        }
+        res.elapsed = tim() - strt;
+    } while (res.elapsed < time_limit);
+    res.ms_per_node = (double)res.elapsed / n_probe_nodes;
+    return res;
+}
@@ -0,0 +1,481 @@
+/*
+    Reverse Othello
+
+    @file search.hpp
+        Path search
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <vector>
+#include "engine/board.hpp"
+#include "engine/util.hpp"
+#include "edge_table.hpp"
+#include "frozen_analysis.hpp"
+#include "flip_all.hpp"
+#include "dead_cache.hpp"
+#include "shared_table.hpp"
+#include "prune_schedule.hpp"
+#include "perf_counters.hpp"
+#include "search_control.hpp"
+#include "trace.hpp"
+
+#define N_INITIAL_DISCS 4
+#define INITIAL_BLACK 0x0000000810000000ULL
+#define INITIAL_WHITE 0x0000001008000000ULL
+
+// side to move of a goal matching either side
+#define PLAYER_ANY 2
+
+// what to do with a path found
+#define PATH_OUTPUT_PRINT 0
+#define PATH_OUTPUT_STORE 1
+#define PATH_OUTPUT_COUNT 2
+
+void output_transcript(std::vector<int> &transcript){
+    uint64_t trace_ts = trace_begin();
+    for (int &move: transcript){
+        std::cout << idx_to_coord(move);
+    }
+    std::cout << std::endl;
+    trace_end("flush", "output", trace_ts);
+}
+
+inline uint64_t full_stability_h(uint64_t full){
+    full &= full >> 1;
+    full &= full >> 2;
+    full &= full >> 4;
+    return (full & 0x0101010101010101ULL) * 0xFF;
+}
+
+inline uint64_t full_stability_v(uint64_t full){
+    full &= (full >> 8) | (full << 56);
+    full &= (full >> 16) | (full << 48);
+    full &= (full >> 32) | (full << 32);
+    return full;
+}
+
+inline void full_stability_d(uint64_t full, uint64_t *full_d7, uint64_t *full_d9){
+    constexpr uint64_t edge = 0xFF818181818181FFULL;
+    uint64_t l7, r7, l9, r9;
+    l7 = r7 = full;
+    l7 &= edge | (l7 >> 7);		r7 &= edge | (r7 << 7);
+    l7 &= 0xFFFF030303030303ULL | (l7 >> 14);	r7 &= 0xC0C0C0C0C0C0FFFFULL | (r7 << 14);
+    l7 &= 0xFFFFFFFF0F0F0F0FULL | (l7 >> 28);	r7 &= 0xF0F0F0F0FFFFFFFFULL | (r7 << 28);
+    *full_d7 = l7 & r7;
+
+    l9 = r9 = full;
+    l9 &= edge | (l9 >> 9);		r9 &= edge | (r9 << 9);
+    l9 &= 0xFFFFC0C0C0C0C0C0ULL | (l9 >> 18);	r9 &= 0x030303030303FFFFULL | (r9 << 18);
+    *full_d9 = l9 & r9 & (0x0F0F0F0FF0F0F0F0ULL | (l9 >> 36) | (r9 << 36));
+}
+
+inline void full_stability(uint64_t discs, uint64_t *h, uint64_t *v, uint64_t *d7, uint64_t *d9){
+    *h = full_stability_h(discs);
+    *v = full_stability_v(discs);
+    full_stability_d(discs, d7, d9);
+}
+
+inline uint64_t enhanced_stability(Board *board, const uint64_t goal_mask){
+    uint64_t full_h, full_v, full_d7, full_d9;
+    uint64_t discs = board->player | board->opponent;
+    full_stability(discs | ~goal_mask, &full_h, &full_v, &full_d7, &full_d9);
+    full_h &= goal_mask;
+    full_v &= goal_mask;
+    full_d7 &= goal_mask;
+    full_d9 &= goal_mask;
+    uint64_t h, v, d7, d9;
+    uint64_t stability = 0ULL, n_stability;
+    n_stability = discs & (full_h & full_v & full_d7 & full_d9);
+    while (n_stability & ~stability){
+        stability |= n_stability;
+        h = (stability >> 1) | (stability << 1) | full_h;
+        v = (stability >> 8) | (stability << 8) | full_v;
+        d7 = (stability >> 7) | (stability << 7) | full_d7;
+        d9 = (stability >> 9) | (stability << 9) | full_d9;
+        n_stability = h & v & d7 & d9;
+    }
+    return stability;
+}
+
+/*
+    @brief check stability conflict with the goal
+
+    @param board                board to check
+    @param goal_mask            goal occupancy
+    @param goal_board_player    goal discs of the side to move
+    @param goal_board_opponent  goal discs of the other side
+    @return a stable disc has the wrong color?
+*/
+inline bool stability_cut(Board *board, const uint64_t goal_mask, const uint64_t goal_board_player, const uint64_t goal_board_opponent){
+    uint64_t stable = enhanced_stability(board, goal_mask);
+    return (stable & board->player & goal_board_opponent) || (stable & board->opponent & goal_board_player);
+}
+
+/*
+    @brief check edge reachability after a move
+
+    @param board                board after the move
+    @param player               side that moved
+    @param cell                 cell of the move
+    @param edge_reachability    edge tables of the goal
+    @return goal unreachable on an edge?
+*/
+inline bool edge_cut(const Board *board, const int player, const uint_fast8_t cell, const Edge_reachability *edge_reachability){
+    // edge lines change only with a move on the edge
+    if ((1ULL << cell) & EDGE_CELLS){
+        uint64_t black = player == BLACK ? board->opponent : board->player;
+        return !edge_reachability->check(black, (board->player | board->opponent) ^ black);
+    }
+    return false;
+}
+
+/*
+    @brief Path search context
+
+    Per-query constants, with the goal boards pre-swapped for both parities
+    ([1]: the side to move is the goal's side to move, [0]: the other side).
+    A goal may be a pattern: the discs of goal must be there, free cells may have
+    any content, and the other cells must be empty.
+
+    @param goal                 goal board (player is the goal's side to move)
+    @param goal_player          side to move of the goal
+    @param any_side             the goal matches with either side to move
+    @param free_mask            cells of the goal with any content
+    @param goal_mask            cells that can be occupied
+    @param corner_mask          cells never flipped in any solution
+    @param goal_n_discs         number of discs of the goal
+    @param goal_board_player    goal discs of the side to move
+    @param goal_board_opponent  goal discs of the other side
+    @param player_color         color of the side to move
+    @param edge_reachability    edge tables of the goal
+    @param last_ply             length of the path before the move that fills goal_mask
+    @param output_mode          PATH_OUTPUT_PRINT / PATH_OUTPUT_STORE / PATH_OUTPUT_COUNT
+    @param dead_cache           results of subtrees (nullptr: not used)
+    @param shared_table         results of subtrees shared by threads (nullptr: not used)
+    @param prune_schedule       plies that run the stability cut (nullptr: all)
+    @param prune_sampling       prune_schedule is still sampling
+    @param perf_counters        counters of the phases of sampled nodes (nullptr: not counted)
+    @param control              limits and progress of the search (nullptr: none)
+    @param next_check           number of nodes at the next check of control
+    @param stopped              the search was stopped by control
+    @param paths                paths found (PATH_OUTPUT_STORE)
+    @param n_nodes              number of visited nodes
+    @param n_solutions          number of solutions
+    @param n_solutions_side     number of solutions by the side to move of the matched board
+*/
+struct Path_context{
+    Board goal;
+    int goal_player;
+    bool any_side;
+    uint64_t free_mask;
+    uint64_t goal_mask;
+    uint64_t corner_mask;
+    int goal_n_discs;
+    uint64_t goal_board_player[2];
+    uint64_t goal_board_opponent[2];
+    int player_color[2];
+    Edge_reachability edge_reachability;
+    int last_ply;
+    int output_mode;
+    Dead_cache *dead_cache;
+    Shared_table *shared_table;
+    Prune_schedule *prune_schedule;
+    bool prune_sampling;
+    Perf_counters *perf_counters;
+    Search_control *control;
+    uint64_t next_check;
+    bool stopped;
+    std::vector<std::vector<int>> paths;
+    uint64_t n_nodes;
+    uint64_t n_solutions;
+    uint64_t n_solutions_side[2];
+
+    /*
+        @brief set the goal
+
+        @param g                    goal board (player is the side to move, black for PLAYER_ANY)
+        @param g_player             side to move of the goal (BLACK / WHITE / PLAYER_ANY)
+        @param g_free               cells of the goal with any content
+    */
+    void init(const Board *g, int g_player, uint64_t g_free = 0ULL){
+        goal = *g;
+        any_side = g_player == PLAYER_ANY;
+        goal_player = any_side ? BLACK : g_player;
+        free_mask = g_free & ~(goal.player | goal.opponent);
+        goal_mask = goal.player | goal.opponent | free_mask;
+        Frozen_analysis frozen_analysis;
+        frozen_analysis.init(goal.player, goal.opponent, free_mask);
+        corner_mask = frozen_analysis.frozen;
+        goal_n_discs = pop_count_ull(goal_mask);
+        goal_board_player[1] = goal.player;
+        goal_board_opponent[1] = goal.opponent;
+        goal_board_player[0] = goal.opponent;
+        goal_board_opponent[0] = goal.player;
+        player_color[1] = goal_player;
+        player_color[0] = goal_player ^ 1;
+        if (goal_player == BLACK)
+            edge_reachability.init(goal.player, goal.opponent, free_mask);
+        else
+            edge_reachability.init(goal.opponent, goal.player, free_mask);
+        // the number of discs of a pattern is not fixed
+        last_ply = free_mask ? -1 : goal_n_discs - N_INITIAL_DISCS - 1;
+        output_mode = PATH_OUTPUT_PRINT;
+        dead_cache = nullptr;
+        shared_table = nullptr;
+        prune_schedule = nullptr;
+        prune_sampling = false;
+        perf_counters = nullptr;
+        control = nullptr;
+        next_check = 0xFFFFFFFFFFFFFFFFULL;
+        stopped = false;
+        paths.clear();
+        n_nodes = 0;
+        n_solutions = 0;
+        n_solutions_side[BLACK] = 0;
+        n_solutions_side[WHITE] = 0;
+    }
+
+    /*
+        @brief set the position the search starts from (default: the initial position)
+
+        @param start                start board
+        @param n_moves              length of the path given with the start board
+    */
+    void set_start(const Board *start, int n_moves){
+        if (free_mask == 0ULL)
+            last_ply = goal_n_discs - start->n_discs() + n_moves - 1;
+    }
+
+    /*
+        @brief check the limits of the search with a control
+
+        @param c                    search control (nullptr: none)
+        @param n_moves              length of the path given with the start board
+    */
+    void set_control(Search_control *c, int n_moves){
+        control = c;
+        stopped = false;
+        next_check = 0xFFFFFFFFFFFFFFFFULL;
+        if (control != nullptr){
+            control->start(n_moves);
+            next_check = n_nodes + SEARCH_CONTROL_CHECK_NODES;
+        }
+    }
+
+    /*
+        @brief the goal is a pattern rather than one position
+
+        @return pattern?
+    */
+    inline bool is_pattern() const{
+        return any_side || free_mask;
+    }
+
+    /*
+        @brief board matches the goal
+
+        Discs outside goal_mask are never placed, so for a full goal this is equality.
+
+        @param board                board to check
+        @param same_side            the side to move is the goal's side to move
+        @return matches?
+    */
+    inline bool match(const Board *board, bool same_side) const{
+        return (same_side || any_side) && (board->player & goal_board_player[same_side]) == goal_board_player[same_side] && (board->opponent & goal_board_opponent[same_side]) == goal_board_opponent[same_side];
+    }
+};
+
+/*
+    @brief record a path to the goal
+
+    @param path                 path
+    @param player               side to move of the matched board
+    @param ctx                  search context
+*/
+inline void path_found(std::vector<int> &path, int player, Path_context *ctx){
+    ++ctx->n_solutions;
+    ++ctx->n_solutions_side[player];
+    if (ctx->output_mode == PATH_OUTPUT_PRINT)
+        output_transcript(path);
+    else if (ctx->output_mode == PATH_OUTPUT_STORE)
+        ctx->paths.emplace_back(path);
+}
+
+/*
+    @brief search paths to the goal
+
+    @param same_side            the side to move is the goal's side to move
+    @param counted              phases are counted with ctx->perf_counters
+    @param board                board to search
+    @param path                 moves so far
+    @param ctx                  search context
+*/
+template <bool same_side, bool counted>
+void find_path_parity(Board *board, std::vector<int> &path, Path_context *ctx){
+    ++ctx->n_nodes;
+    if (ctx->n_nodes >= ctx->next_check){
+        ctx->next_check += SEARCH_CONTROL_CHECK_NODES;
+        ctx->stopped = ctx->control->check(ctx->n_nodes, ctx->n_solutions);
+        if (ctx->stopped){
+            ctx->next_check = 0xFFFFFFFFFFFFFFFFULL;
+            return;
+        }
+    }
+    Perf_counters *perf = counted && ctx->n_nodes % PERF_COUNTERS_SAMPLE_EVERY == 0 ? ctx->perf_counters : nullptr;
+    if (ctx->match(board, same_side)){
+        if (perf != nullptr)
+            perf->begin();
+        path_found(path, ctx->player_color[same_side], ctx);
+        if (perf != nullptr)
+            perf->end(PERF_PHASE_OUTPUT);
+        // a pattern may be matched again after more moves on free cells
+        if (ctx->free_mask == 0ULL)
+            return;
+    }
+    const uint64_t goal_board_player = ctx->goal_board_player[same_side];
+    const uint64_t goal_board_opponent = ctx->goal_board_opponent[same_side];
+    const int n_left = ctx->last_ply - (int)path.size();
+    if (perf != nullptr)
+        perf->begin();
+    bool cut;
+    if (ctx->prune_schedule == nullptr || n_left < 0)
+        cut = stability_cut(board, ctx->goal_mask, goal_board_player, goal_board_opponent);
+    else if (ctx->prune_sampling){
+        if (ctx->prune_schedule->timed()){
+            uint64_t t = __rdtsc();
+            cut = stability_cut(board, ctx->goal_mask, goal_board_player, goal_board_opponent);
+            ctx->prune_schedule->add_ticks(n_left, __rdtsc() - t);
+        } else
+            cut = stability_cut(board, ctx->goal_mask, goal_board_player, goal_board_opponent);
+        if (ctx->prune_schedule->add(n_left, cut)){
+            ctx->prune_schedule->decide(ctx->n_nodes);
+            ctx->prune_sampling = false;
+        }
+    } else
+        cut = ctx->prune_schedule->use_stability[n_left] && stability_cut(board, ctx->goal_mask, goal_board_player, goal_board_opponent);
+    if (perf != nullptr)
+        perf->end(PERF_PHASE_STABILITY);
+    if (cut)
+        return;
+    const int player = ctx->player_color[same_side];
+    // a pattern has no last_ply, so it never uses the cache, and all solutions below are by goal_player
+    const bool cached = ctx->dead_cache != nullptr && n_left >= DEAD_CACHE_MIN_PLIES;
+    const bool shared = ctx->shared_table != nullptr && n_left >= SHARED_TABLE_MIN_PLIES;
+    const uint64_t n_nodes_before = ctx->n_nodes, n_solutions_before = ctx->n_solutions;
+    if (cached){
+        const uint64_t black = player == BLACK ? board->player : board->opponent;
+        const uint64_t white = player == BLACK ? board->opponent : board->player;
+        const Dead_cache_value *value = ctx->dead_cache->find(black, white, player);
+        // transcripts below a live position are still needed unless counting
+        if (value != nullptr && (value->n_solutions == 0 || ctx->output_mode == PATH_OUTPUT_COUNT)){
+            ++ctx->dead_cache->n_hits;
+            ctx->n_solutions += value->n_solutions;
+            ctx->n_solutions_side[ctx->goal_player] += value->n_solutions;
+            return;
+        }
+    }
+    if (shared){
+        uint64_t n_solutions;
+        if (ctx->shared_table->find(board, &n_solutions) && (n_solutions == 0 || ctx->output_mode == PATH_OUTPUT_COUNT)){
+            ctx->shared_table->n_hits.fetch_add(1, std::memory_order_relaxed);
+            ctx->n_solutions += n_solutions;
+            ctx->n_solutions_side[ctx->goal_player] += n_solutions;
+            return;
+        }
+    }
+    if (perf != nullptr)
+        perf->begin();
+    __m256i chain_l, chain_r;
+    uint64_t legal = calc_legal_chain(board->player, board->opponent, &chain_l, &chain_r) & ctx->goal_mask & ~(ctx->corner_mask & goal_board_opponent);
+    if (perf != nullptr)
+        perf->end(PERF_PHASE_MOVE_GENERATION);
+    if (legal){
+        if (perf != nullptr)
+            perf->begin();
+        Flip flips[HW2];
+        int n_moves = calc_flip_all(legal, chain_l, chain_r, flips);
+        if (perf != nullptr)
+            perf->end(PERF_PHASE_FLIP);
+        // last move: children fill goal_mask, so they are only compared with the goal
+        if ((int)path.size() == ctx->last_ply){
+            for (int i = 0; i < n_moves; ++i){
+                const Flip *flip = &flips[i];
+                if (flip->flip & ctx->corner_mask)
+                    continue;
+                board->move_board(flip);
+                if (!edge_cut(board, player, flip->pos, &ctx->edge_reachability)){
+                    ++ctx->n_nodes;
+                    if (ctx->match(board, !same_side)){
+                        if (perf != nullptr)
+                            perf->begin();
+                        path.emplace_back(flip->pos);
+                            path_found(path, ctx->player_color[!same_side], ctx);
+                        path.pop_back();
+                        if (perf != nullptr)
+                            perf->end(PERF_PHASE_OUTPUT);
+                    }
+                }
+                board->undo_board(flip);
+            }
+            return;
+        }
+        // progress is followed in the first plies from the root
+        const int level = ctx->control != nullptr ? (int)path.size() - ctx->control->root_ply : SEARCH_CONTROL_PROGRESS_LEVELS;
+        if (level < SEARCH_CONTROL_PROGRESS_LEVELS)
+            ctx->control->n_children[level] = n_moves;
+        for (int i = 0; i < n_moves; ++i){
+            if (level < SEARCH_CONTROL_PROGRESS_LEVELS){
+                ctx->control->n_done[level] = i;
+                if (level + 1 < SEARCH_CONTROL_PROGRESS_LEVELS)
+                    ctx->control->n_children[level + 1] = 0;
+            }
+            const Flip *flip = &flips[i];
+            if (flip->flip & ctx->corner_mask)
+                continue;
+            board->move_board(flip);
+            if (edge_cut(board, player, flip->pos, &ctx->edge_reachability)){
+                board->undo_board(flip);
+                continue;
+            }
+            path.emplace_back(flip->pos);
+                find_path_parity<!same_side, counted>(board, path, ctx);
+            path.pop_back();
+            board->undo_board(flip);
+            // the subtree is not complete, so it is not cached either
+            if (ctx->stopped)
+                return;
+        }
+        if (level < SEARCH_CONTROL_PROGRESS_LEVELS)
+            ctx->control->n_done[level] = n_moves;
+    }
+    if (cached){
+        const uint64_t black = player == BLACK ? board->player : board->opponent;
+        const uint64_t white = player == BLACK ? board->opponent : board->player;
+        ctx->dead_cache->add(black, white, player, ctx->n_solutions - n_solutions_before, ctx->n_nodes - n_nodes_before);
+    }
+    if (shared)
+        ctx->shared_table->store(board, ctx->n_solutions - n_solutions_before, ctx->n_nodes - n_nodes_before);
+}
+
+/*
+    @brief search paths to the goal
+
+    @param board                board to search
+    @param path                 moves so far
+    @param player               side to move (BLACK / WHITE)
+    @param ctx                  search context
+*/
+inline void find_path(Board *board, std::vector<int> &path, int player, Path_context *ctx){
+    if (ctx->perf_counters != nullptr){
+        if (player == ctx->goal_player)
+            find_path_parity<true, true>(board, path, ctx);
+        else
+            find_path_parity<false, true>(board, path, ctx);
+    } else if (player == ctx->goal_player)
+        find_path_parity<true, false>(board, path, ctx);
+    else
+        find_path_parity<false, false>(board, path, ctx);
+}
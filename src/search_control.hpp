@@ -0,0 +1,140 @@
+/*
+    Reverse Othello
+
+    @file search_control.hpp
+        Progress reporting, limits and interruption of a search
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <csignal>
+#include <iostream>
+#include "engine/board.hpp"
+#include "engine/util.hpp"
+
+// nodes between two checks of the limits
+#define SEARCH_CONTROL_CHECK_NODES 65536
+
+// default interval of progress lines in ms
+#define SEARCH_CONTROL_PROGRESS_INTERVAL 10000
+
+// plies from the root followed for the progress
+#define SEARCH_CONTROL_PROGRESS_LEVELS 8
+
+// reasons to stop
+#define SEARCH_STOP_NONE 0
+#define SEARCH_STOP_TIME 1
+#define SEARCH_STOP_NODES 2
+#define SEARCH_STOP_SIGNAL 3
+
+const std::string search_stop_str[4] = {"", "time limit", "node limit", "signal"};
+
+// set by the signal handler
+volatile std::sig_atomic_t search_signal = 0;
+
+/*
+    @brief stop the search at the next check, a second signal terminates as usual
+
+    @param sig                  signal number
+*/
+extern "C" void search_signal_handler(int sig){
+    search_signal = sig;
+    std::signal(sig, SIG_DFL);
+}
+
+/*
+    @brief catch SIGINT and SIGTERM to stop a search cleanly
+*/
+void search_catch_signals(){
+    std::signal(SIGINT, search_signal_handler);
+    std::signal(SIGTERM, search_signal_handler);
+}
+
+/*
+    @brief Search control
+
+    The search calls check() every SEARCH_CONTROL_CHECK_NODES nodes.
+    Progress is the fraction of the subtrees of the root completed, refined by
+    the fraction completed of the subtree being searched, down to SEARCH_CONTROL_PROGRESS_LEVELS plies.
+
+    @param time_limit           time limit in ms (0: none)
+    @param node_limit           node limit (0: none)
+    @param progress_interval    interval of progress lines in ms (0: none)
+    @param root_ply             length of the path at the root
+    @param n_children           moves of the node being searched at each ply from the root
+    @param n_done               moves searched at each ply from the root
+    @param strt                 time of the start
+    @param last_progress        time of the last progress line
+    @param stop_reason          SEARCH_STOP_*
+*/
+struct Search_control{
+    uint64_t time_limit;
+    uint64_t node_limit;
+    uint64_t progress_interval;
+    int root_ply;
+    int n_children[SEARCH_CONTROL_PROGRESS_LEVELS];
+    int n_done[SEARCH_CONTROL_PROGRESS_LEVELS];
+    uint64_t strt;
+    uint64_t last_progress;
+    int stop_reason;
+
+    Search_control(){
+        time_limit = 0;
+        node_limit = 0;
+        progress_interval = SEARCH_CONTROL_PROGRESS_INTERVAL;
+        start(0);
+    }
+
+    /*
+        @brief start a search
+
+        @param r_ply                length of the path at the root
+    */
+    void start(int r_ply){
+        root_ply = r_ply;
+        for (int i = 0; i < SEARCH_CONTROL_PROGRESS_LEVELS; ++i){
+            n_children[i] = 0;
+            n_done[i] = 0;
+        }
+        strt = tim();
+        last_progress = strt;
+        stop_reason = SEARCH_STOP_NONE;
+    }
+
+    /*
+        @brief fraction of the search completed
+
+        @return estimate from 0.0 to 1.0
+    */
+    double progress() const{
+        double res = 0.0;
+        for (int i = SEARCH_CONTROL_PROGRESS_LEVELS - 1; i >= 0; --i)
+            res = n_children[i] ? (n_done[i] + res) / n_children[i] : 0.0;
+        return res;
+    }
+
+    /*
+        @brief check the limits and show progress
+
+        @param n_nodes              visited nodes
+        @param n_solutions          solutions found
+        @return stop the search?
+    */
+    bool check(uint64_t n_nodes, uint64_t n_solutions){
+        uint64_t now = tim();
+        if (search_signal)
+            stop_reason = SEARCH_STOP_SIGNAL;
+        else if (time_limit && now - strt >= time_limit)
+            stop_reason = SEARCH_STOP_TIME;
+        else if (node_limit && n_nodes >= node_limit)
+            stop_reason = SEARCH_STOP_NODES;
+        if (progress_interval && now - last_progress >= progress_interval){
+            last_progress = now;
+            uint64_t elapsed = std::max<uint64_t>(now - strt, 1);
+            std::cerr << "progress " << n_nodes << " nodes " << n_nodes * 1000 / elapsed << " nps " << n_solutions << " solutions " << (int)(progress() * 1000) / 10.0 << "% in " << elapsed << " ms" << std::endl;
+        }
+        return stop_reason != SEARCH_STOP_NONE;
+    }
+};
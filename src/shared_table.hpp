@@ -0,0 +1,306 @@
+/*
+    Reverse Othello
+
+    @file shared_table.hpp
+        Lock-free table of subtree results shared by threads
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <random>
+#include "engine/board.hpp"
+#include "state_encoding.hpp"
+#ifdef __linux__
+    #include <sys/mman.h>
+#endif
+#ifdef _MSC_VER
+    #include <malloc.h>
+#endif
+
+// subtrees searched with fewer moves left are not looked up
+#define SHARED_TABLE_MIN_PLIES 8
+
+// moves left at least below the frontier searched with the table, so that positions
+// searched from different frontier positions can be looked up
+#define SHARED_TABLE_FRONTIER_PLIES (SHARED_TABLE_MIN_PLIES + 4)
+
+// subtrees with fewer nodes are not stored
+#define SHARED_TABLE_MIN_NODES 1024
+
+// entries per bucket, a bucket is one cache line
+#define SHARED_TABLE_BUCKET_ENTRIES 2
+
+// default size in MB
+#define SHARED_TABLE_DEFAULT_MB 64
+
+// huge page size used to align the table
+#define SHARED_TABLE_HUGE_PAGE (2ULL << 20)
+
+/*
+    @brief Entry of the shared table
+
+    The words are written and read one by one without locks. The key words hold
+    the board XOR a hash of the data, so an entry torn by concurrent writes fails the check.
+    data: n_solutions << 16 | size class << 8 | 1 (0: empty)
+
+    @param player               player discs XOR hash of data
+    @param opponent             opponent discs XOR hash of data
+    @param data                 result of the subtree
+*/
+struct Shared_table_entry{
+    std::atomic<uint64_t> player;
+    std::atomic<uint64_t> opponent;
+    std::atomic<uint64_t> data;
+};
+
+struct alignas(64) Shared_table_bucket{
+    Shared_table_entry entries[SHARED_TABLE_BUCKET_ENTRIES];
+};
+
+/*
+    @brief hash of the data of an entry
+
+    @param data                 data
+    @return hash XORed with the board
+*/
+inline uint64_t shared_table_check(uint64_t data){
+    return hash_compact_state(Compact_state{data, 0});
+}
+
+/*
+    @brief size class of a subtree, used for replacement
+
+    @param n_nodes              nodes of the subtree
+    @return floor(log2(n_nodes))
+*/
+inline uint64_t shared_table_size_class(uint64_t n_nodes){
+    uint64_t res = 0;
+    while (n_nodes >>= 1)
+        ++res;
+    return res;
+}
+
+/*
+    @brief Lock-free table of (board, side to move) -> number of solutions below
+
+    A position is keyed by its board relative to the side to move; without passes
+    the side to move follows from the number of discs. In a bucket, a new result
+    replaces the same board, else an empty entry, else the entry of the smallest subtree.
+    Safe to use from any number of threads.
+
+    @param buckets              buckets
+    @param n_buckets            number of buckets (power of 2)
+    @param n_bytes              size of the table
+    @param huge_pages           the table is mapped with huge pages advised
+    @param n_hits               results used (counted by the search)
+    @param n_stores             results stored
+*/
+class Shared_table{
+    public:
+        std::atomic<uint64_t> n_hits;
+        std::atomic<uint64_t> n_stores;
+
+    private:
+        Shared_table_bucket *buckets;
+        uint64_t n_buckets;
+        uint64_t n_bytes;
+        bool huge_pages;
+
+    public:
+        Shared_table(){
+            buckets = nullptr;
+            n_buckets = 0;
+            n_bytes = 0;
+            huge_pages = false;
+            n_hits = 0;
+            n_stores = 0;
+        }
+
+        ~Shared_table(){
+            free_table();
+        }
+
+        Shared_table(const Shared_table&) = delete;
+        Shared_table &operator=(const Shared_table&) = delete;
+
+        /*
+            @brief allocate an empty table
+
+            @param mb                   size in MB (rounded down to a power of 2 of buckets)
+            @param use_huge_pages       back the table with huge pages where possible
+            @return allocated?
+        */
+        bool init(uint64_t mb, bool use_huge_pages){
+            free_table();
+            n_buckets = 1;
+            while (n_buckets * 2 * sizeof(Shared_table_bucket) <= (mb << 20))
+                n_buckets *= 2;
+            n_bytes = n_buckets * sizeof(Shared_table_bucket);
+        #ifdef __linux__
+            if (use_huge_pages){
+                // over-allocate to align the table to a huge page
+                void *p = mmap(nullptr, n_bytes + SHARED_TABLE_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p != MAP_FAILED){
+                    uintptr_t aligned = ((uintptr_t)p + SHARED_TABLE_HUGE_PAGE - 1) & ~(uintptr_t)(SHARED_TABLE_HUGE_PAGE - 1);
+                    if (aligned != (uintptr_t)p)
+                        munmap(p, aligned - (uintptr_t)p);
+                    munmap((void*)(aligned + n_bytes), (uintptr_t)p + SHARED_TABLE_HUGE_PAGE - aligned);
+                    madvise((void*)aligned, n_bytes, MADV_HUGEPAGE);
+                    // mapped pages are zero, an empty table
+                    buckets = (Shared_table_bucket*)aligned;
+                    huge_pages = true;
+                    return true;
+                }
+            }
+        #endif
+        #ifdef _MSC_VER
+            buckets = (Shared_table_bucket*)_aligned_malloc(n_bytes, 64);
+        #else
+            buckets = (Shared_table_bucket*)aligned_alloc(64, n_bytes);
+        #endif
+            if (buckets == nullptr){
+                n_buckets = 0;
+                return false;
+            }
+            memset((void*)buckets, 0, n_bytes);
+            return true;
+        }
+
+        /*
+            @brief find a position
+
+            @param board                board (player is the side to move)
+            @param n_solutions          number of solutions below to store
+            @return found?
+        */
+        inline bool find(const Board *board, uint64_t *n_solutions){
+            const Shared_table_bucket *bucket = &buckets[hash(board)];
+            for (int i = 0; i < SHARED_TABLE_BUCKET_ENTRIES; ++i){
+                const Shared_table_entry *entry = &bucket->entries[i];
+                uint64_t data = entry->data.load(std::memory_order_relaxed);
+                if (data == 0)
+                    continue;
+                uint64_t check = shared_table_check(data);
+                if ((entry->player.load(std::memory_order_relaxed) ^ check) == board->player && (entry->opponent.load(std::memory_order_relaxed) ^ check) == board->opponent){
+                    *n_solutions = data >> 16;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /*
+            @brief store the result of a subtree
+
+            @param board                board (player is the side to move)
+            @param n_solutions          number of solutions below
+            @param n_nodes              nodes of the subtree
+        */
+        inline void store(const Board *board, uint64_t n_solutions, uint64_t n_nodes){
+            if (n_nodes < SHARED_TABLE_MIN_NODES || (n_solutions >> 48))
+                return;
+            const uint64_t size_class = shared_table_size_class(n_nodes);
+            const uint64_t data = n_solutions << 16 | size_class << 8 | 1;
+            Shared_table_bucket *bucket = &buckets[hash(board)];
+            Shared_table_entry *victim = nullptr;
+            uint64_t victim_size = 0xFFFFFFFFFFFFFFFFULL;
+            for (int i = 0; i < SHARED_TABLE_BUCKET_ENTRIES; ++i){
+                Shared_table_entry *entry = &bucket->entries[i];
+                uint64_t old = entry->data.load(std::memory_order_relaxed);
+                uint64_t old_check = shared_table_check(old);
+                if (old == 0 || ((entry->player.load(std::memory_order_relaxed) ^ old_check) == board->player && (entry->opponent.load(std::memory_order_relaxed) ^ old_check) == board->opponent)){
+                    victim = entry;
+                    victim_size = 0;
+                    break;
+                }
+                uint64_t old_size = (old >> 8) & 0xFF;
+                if (old_size < victim_size){
+                    victim = entry;
+                    victim_size = old_size;
+                }
+            }
+            // keep the results of larger subtrees
+            if (victim_size > size_class)
+                return;
+            const uint64_t check = shared_table_check(data);
+            victim->data.store(data, std::memory_order_relaxed);
+            victim->player.store(board->player ^ check, std::memory_order_relaxed);
+            victim->opponent.store(board->opponent ^ check, std::memory_order_relaxed);
+            n_stores.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /*
+            @brief describe the table
+
+            @return size and backing
+        */
+        std::string str() const{
+            return std::to_string(n_bytes >> 20) + " MB " + (huge_pages ? "huge pages advised" : "normal pages");
+        }
+
+    private:
+        inline uint64_t hash(const Board *board) const{
+            return hash_compact_state(Compact_state{board->player, board->opponent}) & (n_buckets - 1);
+        }
+
+        void free_table(){
+            if (buckets == nullptr)
+                return;
+        #ifdef __linux__
+            if (huge_pages)
+                munmap((void*)buckets, n_bytes);
+            else
+        #endif
+        #ifdef _MSC_VER
+                _aligned_free(buckets);
+        #else
+                free(buckets);
+        #endif
+            buckets = nullptr;
+            huge_pages = false;
+        }
+};
+
+/*
+    @brief stress the table with threads writing and reading the same buckets
+
+    Every board has a fixed result, so a result read for a board must be its own.
+
+    @param table                table to use (small, so that threads collide)
+    @param n_threads            number of threads
+    @param n_ops                operations per thread
+    @param n_boards             number of distinct boards
+    @return number of wrong results read
+*/
+uint64_t shared_table_stress(Shared_table *table, int n_threads, uint64_t n_ops, uint64_t n_boards){
+    std::atomic<uint64_t> n_wrong(0);
+    auto worker = [&](int thread_idx){
+        std::mt19937_64 engine(thread_idx);
+        for (uint64_t i = 0; i < n_ops; ++i){
+            uint64_t k = engine() % n_boards;
+            Board board = {hash_compact_state(Compact_state{k, 1}), hash_compact_state(Compact_state{k, 2})};
+            if (engine() & 1)
+                table->store(&board, k, SHARED_TABLE_MIN_NODES << (k % 8));
+            else{
+                uint64_t n_solutions;
+                if (table->find(&board, &n_solutions) && n_solutions != k)
+                    ++n_wrong;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_threads; ++i)
+        threads.emplace_back(worker, i);
+    worker(0);
+    for (std::thread &thread: threads)
+        thread.join();
+    return n_wrong;
+}
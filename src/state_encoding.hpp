@@ -0,0 +1,403 @@
+/*
+    Reverse Othello
+
+    @file state_encoding.hpp
+        Compact goal-relative state encoding
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <array>
+#include <functional>
+#include <unordered_set>
+#include <unordered_map>
+#include "engine/board.hpp"
+
+/*
+    every position reachable in a query has its discs inside goal_mask,
+    so only pop_count(goal_mask) cells have to be stored
+
+    packed: player and opponent bits gathered into one 64-bit word (up to 32 cells)
+    base3:  cells as base-3 digits (0: empty 1: player 2: opponent) in one word (up to 40 cells)
+    wide:   player and opponent bits gathered into two words
+
+    State_encoder with Compact_state_set and Compact_state_map keys the positions of one goal:
+    the dead positions of the backward search, the unique positions of a frontier level
+    and the dead cache of the goal in memory (its file keeps whole boards).
+    The other stores use Compact_state only as a 16-byte key of a whole board with its hash:
+    --multi mixes several goal masks, the position index outlives one goal mask,
+    and the shared table verifies full boards.
+*/
+#define STATE_ENCODING_PACKED 0
+#define STATE_ENCODING_BASE3 1
+#define STATE_ENCODING_WIDE 2
+
+#define STATE_ENCODING_PACKED_MAX_CELLS 32
+#define STATE_ENCODING_BASE3_MAX_CELLS 40
+
+/*
+    @brief base-3 value of 8 bits (bit i -> 3^i)
+*/
+constexpr std::array<uint64_t, N_8BIT> make_state_encoding_pow3_byte(){
+    std::array<uint64_t, N_8BIT> res{};
+    for (int x = 0; x < N_8BIT; ++x){
+        uint64_t v = 0, p = 1;
+        for (int i = 0; i < HW; ++i){
+            if (1 & (x >> i))
+                v += p;
+            p *= 3;
+        }
+        res[x] = v;
+    }
+    return res;
+}
+
+/*
+    @brief 3^(8 * i)
+*/
+constexpr std::array<uint64_t, HW> make_state_encoding_pow3_chunk(){
+    std::array<uint64_t, HW> res{};
+    uint64_t p = 1;
+    for (int i = 0; i < HW; ++i){
+        res[i] = p;
+        for (int j = 0; j < HW; ++j)
+            p *= 3; // overflows for i >= 5, never used there
+    }
+    return res;
+}
+
+constexpr std::array<uint64_t, N_8BIT> state_encoding_pow3_byte = make_state_encoding_pow3_byte();
+constexpr std::array<uint64_t, HW> state_encoding_pow3_chunk = make_state_encoding_pow3_chunk();
+
+/*
+    @brief gather bits of x selected by mask into the lower bits
+
+    @param x                    a bitboard
+    @param mask                 a mask
+    @return gathered bits
+*/
+inline uint64_t state_encoding_gather(uint64_t x, uint64_t mask){
+    #if USE_BIT_GATHER_OPTIMIZE
+        return _pext_u64(x, mask);
+    #else
+        uint64_t res = 0ULL;
+        for (uint64_t b = 1ULL; mask; b <<= 1){
+            if (x & mask & -mask)
+                res |= b;
+            mask &= mask - 1;
+        }
+        return res;
+    #endif
+}
+
+/*
+    @brief scatter lower bits of x to the bits selected by mask
+
+    @param x                    gathered bits
+    @param mask                 a mask
+    @return bitboard
+*/
+inline uint64_t state_encoding_scatter(uint64_t x, uint64_t mask){
+    #if USE_BIT_GATHER_OPTIMIZE
+        return _pdep_u64(x, mask);
+    #else
+        uint64_t res = 0ULL;
+        for (; mask; x >>= 1){
+            if (x & 1)
+                res |= mask & -mask;
+            mask &= mask - 1;
+        }
+        return res;
+    #endif
+}
+
+/*
+    @brief Compact state
+
+    @param lo                   first word (the only one except in wide mode)
+    @param hi                   second word (0 except in wide mode)
+*/
+struct Compact_state{
+    uint64_t lo;
+    uint64_t hi;
+
+    bool operator==(const Compact_state &other) const{
+        return lo == other.lo && hi == other.hi;
+    }
+
+    bool operator!=(const Compact_state &other) const{
+        return lo != other.lo || hi != other.hi;
+    }
+};
+
+/*
+    @brief hash of a compact state
+
+    @param state                compact state
+    @return 64-bit hash
+*/
+inline uint64_t hash_compact_state(const Compact_state &state){
+    uint64_t x = state.lo ^ (state.hi * 0x9E3779B97F4A7C15ULL);
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+struct Compact_state_hash{
+    size_t operator()(const Compact_state &state) const{
+        return (size_t)hash_compact_state(state);
+    }
+};
+
+/*
+    @brief State encoder for one goal
+
+    @param goal_mask            cells where discs may exist
+    @param n_cells              pop_count(goal_mask)
+    @param mode                 encoding mode
+*/
+class State_encoder{
+    public:
+        uint64_t goal_mask;
+        int n_cells;
+        int mode;
+
+    public:
+        /*
+            @brief set the goal mask and choose the densest encoding
+
+            @param mask                 goal mask
+        */
+        inline void init(uint64_t mask){
+            goal_mask = mask;
+            n_cells = pop_count_ull(mask);
+            if (n_cells <= STATE_ENCODING_PACKED_MAX_CELLS)
+                mode = STATE_ENCODING_PACKED;
+            else if (n_cells <= STATE_ENCODING_BASE3_MAX_CELLS)
+                mode = STATE_ENCODING_BASE3;
+            else
+                mode = STATE_ENCODING_WIDE;
+        }
+
+        /*
+            @brief encode a board
+
+            The board must not have discs outside goal_mask.
+
+            @param board                board to encode
+            @return compact state
+        */
+        inline Compact_state encode(const Board *board) const{
+            Compact_state res;
+            uint64_t p = state_encoding_gather(board->player, goal_mask);
+            uint64_t o = state_encoding_gather(board->opponent, goal_mask);
+            if (mode == STATE_ENCODING_PACKED){
+                res.lo = p | (o << n_cells);
+                res.hi = 0ULL;
+            } else if (mode == STATE_ENCODING_BASE3){
+                res.lo = 0ULL;
+                for (int i = 0; i * HW < n_cells; ++i){
+                    res.lo += (state_encoding_pow3_byte[p & 0xFF] + 2 * state_encoding_pow3_byte[o & 0xFF]) * state_encoding_pow3_chunk[i];
+                    p >>= HW;
+                    o >>= HW;
+                }
+                res.hi = 0ULL;
+            } else{
+                res.lo = p;
+                res.hi = o;
+            }
+            return res;
+        }
+
+        /*
+            @brief decode a compact state
+
+            @param state                compact state
+            @param board                board to store result
+        */
+        inline void decode(const Compact_state &state, Board *board) const{
+            uint64_t p, o;
+            if (mode == STATE_ENCODING_PACKED){
+                p = state.lo & ((1ULL << n_cells) - 1);
+                o = state.lo >> n_cells;
+            } else if (mode == STATE_ENCODING_BASE3){
+                uint64_t x = state.lo;
+                p = 0ULL;
+                o = 0ULL;
+                for (int i = 0; i < n_cells; ++i){
+                    uint64_t d = x % 3;
+                    x /= 3;
+                    p |= (uint64_t)(d == 1) << i;
+                    o |= (uint64_t)(d == 2) << i;
+                }
+            } else{
+                p = state.lo;
+                o = state.hi;
+            }
+            board->player = state_encoding_scatter(p, goal_mask);
+            board->opponent = state_encoding_scatter(o, goal_mask);
+        }
+
+        /*
+            @brief bytes needed to store a key in this mode
+
+            @return number of bytes
+        */
+        inline int key_bytes() const{
+            return mode == STATE_ENCODING_WIDE ? 16 : 8;
+        }
+};
+
+/*
+    @brief Set of compact states of one encoder
+
+    Keys of the packed and base-3 modes are stored as one word,
+    so only the wide mode pays for two.
+
+    @param wide                 keys need two words
+    @param narrow_set           keys of the packed and base-3 modes
+    @param wide_set             keys of the wide mode
+*/
+class Compact_state_set{
+    private:
+        bool wide;
+        std::unordered_set<uint64_t> narrow_set;
+        std::unordered_set<Compact_state, Compact_state_hash> wide_set;
+
+    public:
+        /*
+            @brief empty the set and choose the key width
+
+            @param encoder              encoder of the keys
+        */
+        inline void init(const State_encoder *encoder){
+            wide = encoder->key_bytes() > 8;
+            narrow_set.clear();
+            wide_set.clear();
+        }
+
+        inline size_t size() const{
+            return wide ? wide_set.size() : narrow_set.size();
+        }
+
+        inline bool contains(const Compact_state &state) const{
+            return wide ? wide_set.find(state) != wide_set.end() : narrow_set.find(state.lo) != narrow_set.end();
+        }
+
+        inline void insert(const Compact_state &state){
+            if (wide)
+                wide_set.insert(state);
+            else
+                narrow_set.insert(state.lo);
+        }
+};
+
+/*
+    @brief Map from the compact states of one encoder
+
+    Keys of the packed and base-3 modes are stored as one word,
+    so only the wide mode pays for two.
+
+    @param wide                 keys need two words
+    @param narrow_map           entries of the packed and base-3 modes
+    @param wide_map             entries of the wide mode
+*/
+template <typename T>
+class Compact_state_map{
+    private:
+        bool wide;
+        std::unordered_map<uint64_t, T> narrow_map;
+        std::unordered_map<Compact_state, T, Compact_state_hash> wide_map;
+
+    public:
+        /*
+            @brief empty the map and choose the key width
+
+            @param encoder              encoder of the keys
+        */
+        inline void init(const State_encoder *encoder){
+            wide = encoder->key_bytes() > 8;
+            narrow_map.clear();
+            wide_map.clear();
+        }
+
+        inline void reserve(size_t n){
+            if (wide)
+                wide_map.reserve(n);
+            else
+                narrow_map.reserve(n);
+        }
+
+        inline size_t size() const{
+            return wide ? wide_map.size() : narrow_map.size();
+        }
+
+        inline size_t bucket_count() const{
+            return wide ? wide_map.bucket_count() : narrow_map.bucket_count();
+        }
+
+        /*
+            @brief find a state
+
+            @param state                compact state
+            @return value, nullptr if not found
+        */
+        inline const T *find(const Compact_state &state) const{
+            if (wide){
+                const auto elem = wide_map.find(state);
+                return elem == wide_map.end() ? nullptr : &elem->second;
+            }
+            const auto elem = narrow_map.find(state.lo);
+            return elem == narrow_map.end() ? nullptr : &elem->second;
+        }
+
+        /*
+            @brief insert a state unless it is there
+
+            @param state                compact state
+            @param value                value of a new state
+            @return value of the state and whether it was inserted
+        */
+        inline std::pair<T*, bool> emplace(const Compact_state &state, const T &value){
+            if (wide){
+                auto elem = wide_map.emplace(state, value);
+                return std::make_pair(&elem.first->second, elem.second);
+            }
+            auto elem = narrow_map.emplace(state.lo, value);
+            return std::make_pair(&elem.first->second, elem.second);
+        }
+
+        /*
+            @brief set the value of a state
+
+            @param state                compact state
+            @param value                value
+        */
+        inline void assign(const Compact_state &state, const T &value){
+            if (wide)
+                wide_map[state] = value;
+            else
+                narrow_map[state.lo] = value;
+        }
+
+        /*
+            @brief call f with every state and its value
+
+            @param f                    function called with (state, value)
+        */
+        template <typename F>
+        void for_each(F &f) const{
+            if (wide){
+                for (const auto &elem: wide_map)
+                    f(elem.first, elem.second);
+            } else{
+                for (const auto &elem: narrow_map)
+                    f(Compact_state{elem.first, 0ULL}, elem.second);
+            }
+        }
+};
@@ -0,0 +1,218 @@
+/*
+    Reverse Othello
+
+    @file trace.hpp
+        Timeline of a run in the Chrome trace event format
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+// events kept per thread, older events are overwritten
+#define TRACE_BUFFER_EVENTS 65536
+
+/*
+    @brief Trace event
+
+    @param name                 name (string literal)
+    @param category             category (string literal)
+    @param ts                   start in ns from the start of the trace
+    @param dur                  duration in ns (complete events)
+    @param arg                  argument shown with the event
+    @param ph                   'X': complete event 'i': instant event
+*/
+struct Trace_event{
+    const char *name;
+    const char *category;
+    uint64_t ts;
+    uint64_t dur;
+    uint64_t arg;
+    char ph;
+};
+
+/*
+    @brief Ring buffer of the events of one thread
+
+    Only its thread writes it, the trace reads it after the threads are joined.
+
+    @param tid                  thread id in the trace
+    @param name                 thread name
+    @param events               ring buffer
+    @param n_events             events recorded, including the overwritten ones
+*/
+struct Trace_buffer{
+    int tid;
+    std::string name;
+    std::vector<Trace_event> events;
+    uint64_t n_events;
+
+    inline void add(const Trace_event &event){
+        events[n_events % TRACE_BUFFER_EVENTS] = event;
+        ++n_events;
+    }
+};
+
+/*
+    @brief Trace of a run
+
+    Disabled unless start() is called. Events are recorded without locks in the
+    buffer of the calling thread; a lock is only taken the first time a thread records.
+    The trace is written when the program exits.
+
+    @param enabled              record events?
+    @param path                 output file
+    @param strt                 start of the trace
+    @param buffers              buffers of all threads
+    @param mtx                  lock of buffers
+*/
+class Trace{
+    public:
+        bool enabled;
+
+    private:
+        std::string path;
+        std::chrono::steady_clock::time_point strt;
+        std::vector<std::unique_ptr<Trace_buffer>> buffers;
+        std::mutex mtx;
+
+    public:
+        Trace(){
+            enabled = false;
+        }
+
+        ~Trace(){
+            if (enabled)
+                save();
+        }
+
+        /*
+            @brief start recording
+
+            @param p                    output file
+        */
+        void start(const std::string &p){
+            path = p;
+            strt = std::chrono::steady_clock::now();
+            enabled = true;
+        }
+
+        /*
+            @brief current time
+
+            @return ns from the start of the trace
+        */
+        inline uint64_t now() const{
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - strt).count();
+        }
+
+        /*
+            @brief buffer of the calling thread
+
+            @return buffer
+        */
+        Trace_buffer *buffer(){
+            thread_local Trace_buffer *thread_buffer = nullptr;
+            if (thread_buffer == nullptr){
+                std::lock_guard<std::mutex> lock(mtx);
+                buffers.emplace_back(new Trace_buffer);
+                thread_buffer = buffers.back().get();
+                thread_buffer->tid = (int)buffers.size() - 1;
+                thread_buffer->name = "thread " + std::to_string(thread_buffer->tid);
+                thread_buffer->events.resize(TRACE_BUFFER_EVENTS);
+                thread_buffer->n_events = 0;
+            }
+            return thread_buffer;
+        }
+
+        /*
+            @brief write the trace
+
+            @return written?
+        */
+        bool save(){
+            FILE *out = fopen(path.c_str(), "w");
+            if (out == nullptr){
+                std::cerr << "[ERROR] can't open " << path << std::endl;
+                return false;
+            }
+            uint64_t n_dropped = 0;
+            fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+            fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Reverse_Othello\"}}");
+            for (const std::unique_ptr<Trace_buffer> &buf: buffers){
+                fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", buf->tid, buf->name.c_str());
+                uint64_t first = buf->n_events > TRACE_BUFFER_EVENTS ? buf->n_events - TRACE_BUFFER_EVENTS : 0;
+                n_dropped += first;
+                for (uint64_t i = first; i < buf->n_events; ++i){
+                    const Trace_event &e = buf->events[i % TRACE_BUFFER_EVENTS];
+                    fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,", e.name, e.category, e.ph, e.ts / 1000.0);
+                    if (e.ph == 'X')
+                        fprintf(out, "\"dur\":%.3f,", e.dur / 1000.0);
+                    else
+                        fprintf(out, "\"s\":\"t\",");
+                    fprintf(out, "\"pid\":1,\"tid\":%d,\"args\":{\"arg\":%llu}}", buf->tid, (unsigned long long)e.arg);
+                }
+            }
+            fprintf(out, "\n]}\n");
+            bool res = fclose(out) == 0;
+            std::cerr << "trace " << buffers.size() << " threads written to " << path;
+            if (n_dropped)
+                std::cerr << ", " << n_dropped << " oldest events dropped";
+            std::cerr << std::endl;
+            return res;
+        }
+};
+
+Trace trace;
+
+/*
+    @brief start of a complete event
+
+    @return start time, 0 if tracing is disabled
+*/
+inline uint64_t trace_begin(){
+    return trace.enabled ? trace.now() : 0;
+}
+
+/*
+    @brief record a complete event begun with trace_begin
+
+    @param name                 name (string literal)
+    @param category             category (string literal)
+    @param ts                   value of trace_begin
+    @param arg                  argument shown with the event
+*/
+inline void trace_end(const char *name, const char *category, uint64_t ts, uint64_t arg = 0){
+    if (trace.enabled)
+        trace.buffer()->add(Trace_event{name, category, ts, trace.now() - ts, arg, 'X'});
+}
+
+/*
+    @brief record an instant event
+
+    @param name                 name (string literal)
+    @param category             category (string literal)
+    @param arg                  argument shown with the event
+*/
+inline void trace_instant(const char *name, const char *category, uint64_t arg = 0){
+    if (trace.enabled)
+        trace.buffer()->add(Trace_event{name, category, trace.now(), 0, arg, 'i'});
+}
+
+/*
+    @brief name the calling thread in the trace
+
+    @param name                 thread name
+*/
+inline void trace_thread_name(const char *name){
+    if (trace.enabled)
+        trace.buffer()->name = name;
+}
@@ -0,0 +1,67 @@
+/*
+    Reverse Othello
+
+    @file transcript.hpp
+        Transcript parsing and replay
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include "engine/board.hpp"
+#include "engine/util.hpp"
+
+/*
+    @brief Generate index of a coordinate (inverse of idx_to_coord)
+
+    @param x_char               column (a-h, case insensitive)
+    @param y_char               row (1-8)
+    @return index of the coordinate, -1 if invalid
+*/
+inline int coord_to_idx(char x_char, char y_char){
+    if ('A' <= x_char && x_char <= 'H')
+        x_char += 'a' - 'A';
+    if (x_char < 'a' || 'h' < x_char || y_char < '1' || '8' < y_char)
+        return -1;
+    int x = x_char - 'a';
+    int y = y_char - '1';
+    return HW2_M1 - (y * HW + x);
+}
+
+/*
+    @brief replay a transcript
+
+    Every move must be legal. Passes are not allowed, as in the search.
+
+    @param transcript           transcript like f5d6c3
+    @param board                board to start from (player is the side to move), updated
+    @param player               side to move (BLACK / WHITE), updated
+    @param moves                vector to append the moves to
+    @return valid?
+*/
+bool replay_transcript(const std::string &transcript, Board *board, int *player, std::vector<int> &moves){
+    if (transcript.length() % 2){
+        std::cerr << "[ERROR] invalid transcript " << transcript << std::endl;
+        return false;
+    }
+    Flip flip;
+    for (int i = 0; i < (int)transcript.length(); i += 2){
+        int cell = coord_to_idx(transcript[i], transcript[i + 1]);
+        if (cell < 0){
+            std::cerr << "[ERROR] invalid coordinate " << transcript.substr(i, 2) << std::endl;
+            return false;
+        }
+        if ((1 & (board->get_legal() >> cell)) == 0){
+            std::cerr << "[ERROR] illegal move " << transcript.substr(i, 2) << " at move " << i / 2 + 1 << std::endl;
+            return false;
+        }
+        calc_flip(&flip, board, cell);
+        board->move_board(&flip);
+        *player ^= 1;
+        moves.emplace_back(cell);
+    }
+    return true;
+}
@@ -0,0 +1,203 @@
+/*
+    Reverse Othello
+
+    @file verify.hpp
+        Bulk transcript verification
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "engine/board.hpp"
+#include "search.hpp"
+#include "transcript.hpp"
+
+// result of a transcript
+#define VERIFY_OK 0
+#define VERIFY_NO_GOAL 1
+#define VERIFY_BAD_COORDINATE 2
+#define VERIFY_ILLEGAL_MOVE 3
+#define VERIFY_WRONG_POSITION 4
+
+// transcripts replayed in one task (at least)
+#define VERIFY_TASK_MIN 1024
+
+const std::string verify_result_str[5] = {"ok", "no goal", "bad coordinate", "illegal move", "wrong position"};
+
+/*
+    @brief Goal of transcripts
+
+    @param black                black discs that must be there
+    @param white                white discs that must be there
+    @param free_mask            cells with any content
+    @param player               side to move (BLACK / WHITE / PLAYER_ANY)
+*/
+struct Verify_goal{
+    uint64_t black;
+    uint64_t white;
+    uint64_t free_mask;
+    int player;
+
+    /*
+        @brief board matches the goal
+
+        @param board                board (player is the side to move)
+        @param p                    side to move
+        @return matches?
+    */
+    inline bool match(const Board *board, int p) const{
+        if (player != PLAYER_ANY && player != p)
+            return false;
+        uint64_t b = p == BLACK ? board->player : board->opponent;
+        uint64_t w = p == BLACK ? board->opponent : board->player;
+        return (b & black) == black && (w & white) == white && ((b | w) & ~(black | white | free_mask)) == 0;
+    }
+};
+
+/*
+    @brief Transcript to verify
+
+    @param line                 line number in the input
+    @param goal                 index of the goal, -1 if none
+    @param transcript           transcript (lower case)
+    @param result               VERIFY_*
+    @param ply                  move where an error was found
+*/
+struct Verify_transcript{
+    int line;
+    int goal;
+    std::string transcript;
+    int result;
+    int ply;
+
+    bool operator<(const Verify_transcript &another) const{
+        if (goal != another.goal)
+            return goal < another.goal;
+        return transcript < another.transcript;
+    }
+};
+
+/*
+    @brief verify transcripts of one goal sorted by transcript
+
+    Sorted transcripts visit the trie of transcripts depth first,
+    so each one is replayed only from the longest prefix shared with the previous one.
+    A move is legal iff it is on an empty cell and flips some discs.
+
+    @param goal                 goal of the transcripts
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param items                transcripts
+    @param n                    number of transcripts
+    @return number of moves replayed
+*/
+uint64_t verify_sorted(const Verify_goal *goal, const Board *start, int start_player, Verify_transcript *items, int n){
+    Board boards[HW2 + 1];
+    boards[0] = *start;
+    int n_valid = 0; // boards[0 ... n_valid] are the positions of prev
+    const std::string *prev = nullptr;
+    uint64_t n_moves = 0;
+    Flip flip;
+    for (int i = 0; i < n; ++i){
+        Verify_transcript &item = items[i];
+        const std::string &t = item.transcript;
+        int ply = 0;
+        if (prev != nullptr){
+            int n_common = (int)(std::mismatch(prev->begin(), prev->begin() + std::min(prev->size(), t.size()), t.begin()).first - prev->begin());
+            ply = std::min(n_common / 2, n_valid);
+        }
+        item.result = VERIFY_OK;
+        int n_ply = (int)t.length() / 2;
+        if (t.length() % 2){
+            item.result = VERIFY_BAD_COORDINATE;
+            item.ply = n_ply + 1;
+            continue;
+        }
+        // the board is full after HW2 - n_discs moves
+        int n_replay = std::min(n_ply, HW2 - start->n_discs());
+        for (; ply < n_replay; ++ply){
+            int cell = coord_to_idx(t[ply * 2], t[ply * 2 + 1]);
+            if (cell < 0){
+                item.result = VERIFY_BAD_COORDINATE;
+                break;
+            }
+            boards[ply + 1] = boards[ply];
+            if ((1 & ((boards[ply].player | boards[ply].opponent) >> cell)) || calc_flip(&flip, &boards[ply + 1], cell) == 0ULL){
+                item.result = VERIFY_ILLEGAL_MOVE;
+                break;
+            }
+            boards[ply + 1].move_board(&flip);
+            ++n_moves;
+        }
+        n_valid = ply;
+        prev = &t;
+        if (item.result == VERIFY_OK && n_ply > n_replay)
+            item.result = VERIFY_ILLEGAL_MOVE;
+        if (item.result != VERIFY_OK){
+            item.ply = ply + 1;
+            continue;
+        }
+        if (!goal->match(&boards[n_ply], start_player ^ (n_ply & 1))){
+            item.result = VERIFY_WRONG_POSITION;
+            item.ply = n_ply;
+        }
+    }
+    return n_moves;
+}
+
+/*
+    @brief verify transcripts with threads
+
+    Transcripts are sorted by goal and transcript, and split into tasks
+    that threads take one by one.
+
+    @param goals                goals
+    @param start                start board (player is the side to move)
+    @param start_player         side to move of the start board
+    @param items                transcripts (sorted on return)
+    @param n_threads            number of threads
+    @return number of moves replayed
+*/
+uint64_t verify_transcripts(const std::vector<Verify_goal> &goals, const Board *start, int start_player, std::vector<Verify_transcript> &items, int n_threads){
+    std::sort(items.begin(), items.end());
+    int task_size = std::max(VERIFY_TASK_MIN, (int)(items.size() / (4 * n_threads) + 1));
+    std::vector<std::pair<int, int>> tasks;
+    for (int i = 0; i < (int)items.size();){
+        int j = i;
+        while (j < (int)items.size() && j - i < task_size && items[j].goal == items[i].goal)
+            ++j;
+        tasks.emplace_back(std::make_pair(i, j));
+        i = j;
+    }
+    std::atomic<int> next_task(0);
+    std::atomic<uint64_t> n_moves(0);
+    auto worker = [&](){
+        int task;
+        while ((task = next_task.fetch_add(1)) < (int)tasks.size()){
+            Verify_transcript *begin = &items[tasks[task].first];
+            int n = tasks[task].second - tasks[task].first;
+            uint64_t trace_ts = trace_begin();
+            if (begin->goal < 0){
+                for (int i = 0; i < n; ++i){
+                    begin[i].result = VERIFY_NO_GOAL;
+                    begin[i].ply = 0;
+                }
+            } else
+                n_moves += verify_sorted(&goals[begin->goal], start, start_player, begin, n);
+            trace_end("task", "verify", trace_ts, n);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_threads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (std::thread &thread: threads)
+        thread.join();
+    return n_moves;
+}
@@ -0,0 +1,122 @@
+/*
+    Reverse Othello
+
+    @file waypoint.hpp
+        Search for games passing through several positions in order
+    @date 2024
+    @author Takuto Yamana
+    @license GPL-3.0 license
+*/
+
+#pragma once
+#include <vector>
+#include "engine/board.hpp"
+#include "search.hpp"
+
+/*
+    @brief Waypoint search
+
+    A game through the waypoints is a path to the first waypoint followed by a path
+    from it to the second one, and so on. The paths of a segment do not depend on
+    how its first waypoint was reached, so each segment is searched only once
+    with its own goal_mask and corner_mask, and the reached waypoints are kept
+    as the start positions of the next segments.
+
+    @param waypoints            positions to pass through (player is the side to move)
+    @param players              side to move of each waypoint
+    @param starts               start position of each segment (player is the side to move)
+    @param start_players        side to move of the start of each segment
+    @param paths                paths of each segment (not stored when counting)
+    @param n_solutions          number of paths of each segment
+    @param n_nodes              number of visited nodes
+    @param overflow             the number of games does not fit in 64 bits
+*/
+struct Waypoint_search{
+    std::vector<Board> waypoints;
+    std::vector<int> players;
+    std::vector<Board> starts;
+    std::vector<int> start_players;
+    std::vector<std::vector<std::vector<int>>> paths;
+    std::vector<uint64_t> n_solutions;
+    uint64_t n_nodes;
+    bool overflow;
+
+    /*
+        @brief set the waypoints
+
+        @param start                start board (player is the side to move)
+        @param start_player         side to move of the start board
+        @param w                    waypoints, the last one is the goal
+        @param w_players            side to move of each waypoint
+    */
+    void init(const Board *start, int start_player, const std::vector<Board> &w, const std::vector<int> &w_players){
+        waypoints = w;
+        players = w_players;
+        starts.clear();
+        start_players.clear();
+        starts.emplace_back(*start);
+        start_players.emplace_back(start_player);
+        for (int i = 0; i + 1 < (int)waypoints.size(); ++i){
+            starts.emplace_back(waypoints[i]);
+            start_players.emplace_back(players[i]);
+        }
+        paths.assign(waypoints.size(), std::vector<std::vector<int>>());
+        n_solutions.assign(waypoints.size(), 0);
+        n_nodes = 0;
+        overflow = false;
+    }
+
+    /*
+        @brief search every segment
+
+        Stops at the first segment without paths.
+
+        @param count_only           only count the paths
+        @return number of games through all waypoints (saturated at UINT64_MAX with overflow)
+    */
+    uint64_t search(bool count_only){
+        uint64_t res = 1;
+        for (int i = 0; i < (int)waypoints.size(); ++i){
+            Path_context ctx;
+            ctx.init(&waypoints[i], players[i]);
+            ctx.set_start(&starts[i], 0);
+            ctx.output_mode = count_only ? PATH_OUTPUT_COUNT : PATH_OUTPUT_STORE;
+            Board board = starts[i];
+            std::vector<int> path;
+            find_path(&board, path, start_players[i], &ctx);
+            n_nodes += ctx.n_nodes;
+            n_solutions[i] = ctx.n_solutions;
+            paths[i].swap(ctx.paths);
+            if (n_solutions[i] == 0){
+                overflow = false;
+                return 0;
+            }
+            if (res > 0xFFFFFFFFFFFFFFFFULL / n_solutions[i]){
+                res = 0xFFFFFFFFFFFFFFFFULL;
+                overflow = true;
+            } else
+                res *= n_solutions[i];
+        }
+        return res;
+    }
+};
+
+/*
+    @brief output every game through the waypoints
+
+    @param search               searched waypoints
+    @param segment              segment to append
+    @param transcript           moves so far
+*/
+void output_transcript_waypoint(const Waypoint_search *search, int segment, std::vector<int> &transcript){
+    if (segment == (int)search->waypoints.size()){
+        output_transcript(transcript);
+        return;
+    }
+    size_t n_moves = transcript.size();
+    for (const std::vector<int> &path: search->paths[segment]){
+        transcript.insert(transcript.end(), path.begin(), path.end());
+            output_transcript_waypoint(search, segment + 1, transcript);
+        transcript.resize(n_moves);
+    }
+}